@@ -6,54 +6,457 @@
 //============================================
 
 #include <stdio.h>
+#include <limits.h>
 #include <sel4/sel4.h>
 #include <sel4platsupport/bootinfo.h>
+#include "memserver.h"
+#include "regions.h"
 
-#define FALSE 0
-#define TRUE !(FALSE)
-#define MAX_MEMORY_REGIONS 512
+#define CNODE_OP_COPY 0
+#define CNODE_OP_MINT 1
+#define CNODE_OP_MOVE 2
+#define CNODE_OP_DELETE 3
+#define MEMORY_SERVER_MODE FALSE	// TRUE: Root_task queda atendiendo peticiones de memoria
+#define MAX_CLIENT_RINGS 32
+#define RING_VADDR_BASE 0x40000000	// donde mapea Root_task los anillos de los clientes
+#define CLIENT_BADGE_FLAG ((seL4_Word) 1 << 62)	// distingue badges de endpoint de los timbres
+#define OWNER_UNTYPED ((seL4_Word) 1 << 61)	// marca del owner de las regiones con untyped propio (sub-arenas y untyped_reserve())
+#define OWNER_EXTENT ((seL4_Word) 1 << 60)	// marca del owner de los trozos de allocate_extents()
+#define OWNER_HANDLE ((seL4_Word) 1 << 59)	// marca del owner de las regiones de allocate_handle()
+#define OWNER_SLAB ((seL4_Word) 1 << 58)	// marca del owner de las paginas de los slabs
+#define OWNER_TAGS (OWNER_UNTYPED | OWNER_EXTENT | OWNER_HANDLE | OWNER_SLAB)	// marcas que release()/resize() no aceptan como cliente
+#define MAX_UNTYPED_NODES 1024
+#define MAX_SUB_ARENAS 128
+#define MAX_EXTENT_MAPS 256	// lotes de frames mapeados con map_extents() a la vez
+#define MAX_CLIENTS 64		// los badges de los clientes van de 1 a MAX_CLIENTS-1
+#define ROOT_CLIENT 0		// cuenta de las reservas propias de Root_task
+#define CNODE_SLOTS ((seL4_Word) 1 << CONFIG_ROOT_CNODE_SIZE_BITS)	// slots del CNode raiz y de cada CNode de nivel 2
+#define CSPACE_TOP_BITS 8		// el CSpace puede crecer hasta 2^8 CNodes de nivel 2
+#define CSPACE_GROW_RESERVE 32	// slots libres que necesita cspace_grow()
+#define MAX_SLOTS (CNODE_SLOTS << CSPACE_TOP_BITS)
+#define SLOT_WORDS (MAX_SLOTS / seL4_WordBits)
+#define SLOT_SUMMARY_WORDS ((SLOT_WORDS + seL4_WordBits - 1) / seL4_WordBits)
+#define POOL_TYPES 3		// TCBs, endpoints y notifications
+#define POOL_REFILL_BITS 4	// cada relleno de un pool crea 2^4 objetos
+#define POOL_REFILL (1 << POOL_REFILL_BITS)
+#define POOL_MAX_OBJECTS 256	// objetos de cada tipo como maximo
+#define MAX_OBJECT_CHUNKS 256	// trozos de objetos creados por allocate_object()
+#define OBJECT_MOVE_BATCH 32	// movimientos de capacidades por cnode_batch()
+#define SLAB_MIN_BITS 4		// objetos de slab de 16 bytes como minimo
+#define SLAB_CLASSES (seL4_PageBits - SLAB_MIN_BITS)	// clases de 16 a 2048 bytes
+#define SLAB_MAX_SIZE ((seL4_Word) 1 << (seL4_PageBits - 1))
+#define SLAB_OBJECTS(c) (1 << (seL4_PageBits - SLAB_MIN_BITS - (c)))	// objetos en un slab de clase c
+#define SLAB_MAP_WORDS ((1 << (seL4_PageBits - SLAB_MIN_BITS)) / seL4_WordBits)
+#define MAX_SLABS 256
+#define SLAB_HASH_BUCKETS MAX_SLABS	// listas de slabs por pagina de slab_find()
+#define MAX_HANDLES MAX_MEMORY_REGIONS	// como mucho una region reservada por handle
+#define HANDLE_INDEX_BITS 16	// bits bajos del handle: indice en handleTable.handles[]
+#define LOW_WATERMARK_SHIFT 3	// marca baja por defecto: 1/8 de la memoria gestionada
+#define HIGH_WATERMARK_SHIFT 2	// marca alta por defecto: 1/4 de la memoria gestionada
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //  DEFINIDION GLOBAL DE ESTRUCTURAS, CONSTANTES, VARIABLES Y PUNTEROS
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /**
- * Registro que define una region de memoria
- * @paddr direccion de inicio de la region
- * @sizeBitsPow tamaño de la region de memoria (2^sizeBits)
- * @isAllocated si esta lible (false) u ocupada (true)
+ * Lista estatica con la copia de boot_info->untypedList[] para 
+ * ser ordenada por paddr, ya que no se puede modificar la original
+ * @myUntypedList array con los slots de memoria libre asignada a
+ *                Root_task que cumplen (isDevice == 0)
+ * @countSlots contador de los slots de memoria libre
+ */
+struct Slots {
+    seL4_UntypedDesc myUntypedList[CONFIG_MAX_NUM_BOOTINFO_UNTYPED_CAPS];
+    int countSlots;
+};
+
+/**
+ * Descriptor de un grupo de objetos del mismo tipo para retype_batch()
+ * @type tipo de objeto seL4 (seL4_TCBObject, seL4_EndpointObject, seL4_X86_4K...)
+ * @sizeBits tamaño indicado por el usuario (solo CNodes y untyped), 0 e.o.c
+ * @count numero de objetos de ese tipo a crear
+ */
+struct ObjectDesc {
+    seL4_Word type;
+    seL4_Uint8 sizeBits;
+    int count;
+};
+
+/**
+ * Operacion sobre el CNode raiz para cnode_batch()
+ * @op CNODE_OP_COPY, CNODE_OP_MINT, CNODE_OP_MOVE o CNODE_OP_DELETE
+ * @src slot origen (no se usa en CNODE_OP_DELETE)
+ * @dest slot destino (slot a borrar en CNODE_OP_DELETE)
+ * @rights derechos de la nueva capacidad (COPY y MINT)
+ * @badge badge de la nueva capacidad (solo MINT)
  */
-struct Region {
+struct CNodeOp {
+    int op;
+    seL4_CPtr src;
+    seL4_CPtr dest;
+    seL4_CapRights_t rights;
+    seL4_Word badge;
+};
+
+/**
+ * Estado de la memoria gestionada (respuesta de MEMSRV_STAT)
+ * @freeBytes bytes libres en total
+ * @largestFree tamaño de la mayor region libre
+ * @allocatedBytes bytes reservados en total
+ * @countRegions numero de regiones (libres y reservadas)
+ */
+struct MemoryStat {
+    seL4_Word freeBytes;
+    seL4_Word largestFree;
+    seL4_Word allocatedBytes;
+    seL4_Word countRegions;
+};
+
+/**
+ * Anillos de peticiones asincronas registrados por los clientes
+ * @ring[] anillo mapeado en el espacio de Root_task (indice = bit del timbre),
+ *         NULL si el anillo se ha dado de baja
+ * @frame[] frame de cada anillo
+ * @client[] cliente al que pertenece cada anillo
+ * @countRings numero de indices usados (anillos registrados o dados de baja)
+ */
+struct ClientRings {
+    struct MemsrvRing *ring[MAX_CLIENT_RINGS];
+    seL4_CPtr frame[MAX_CLIENT_RINGS];
+    seL4_Word client[MAX_CLIENT_RINGS];
+    int countRings;
+};
+
+/**
+ * Nodo del arbol de untyped derivados de la region gestionada. Cada nodo
+ * sin usar puede dividirse en dos mitades (retype en 2 untyped de la mitad
+ * de tamaño), igual que un buddy, de modo que cualquier region alineada a su
+ * tamaño que reparta allocate_aligned() tiene su propio untyped
+ * @cap capacidad del untyped
+ * @paddr direccion de inicio
+ * @sizeBits tamaño (2^sizeBits)
+ * @parent nodo padre, -1 en los untyped de boot_info
+ * @child primera mitad (la segunda es child+1), -1 si no esta dividido
+ * @inUse si el untyped (o lo creado a partir de el) esta entregado
+ * @watermark bytes ya consumidos por retypes de Root_task (todo el nodo
+ *            si esta dividido, 0 si se puede volver a usar sin reset)
+ */
+struct UntypedNode {
+    seL4_CPtr cap;
     seL4_Word paddr;
-    unsigned int sizeBitsPow;	// si se define como seL4_Uint8 da problema de asignacion
-    seL4_Bool isAllocated;
+    seL4_Uint8 sizeBits;
+    int parent;
+    int child;
+    seL4_Bool inUse;
+    seL4_Word watermark;
 };
 
 /**
- * Lista estatica de regiones (una region = 1..n slots consecutivos)
- * @regions array con las regiones identificadas
- * @countRegions contador de diferentes regiones identificadas
+ * Arbol de untyped: las raices ocupan nodes[0..countRoots-1] y el resto de
+ * nodos se reservan por parejas de hermanos
+ * @nodes[] nodos del arbol
+ * @countNodes nodos usados de nodes[]
+ * @countRoots numero de raices (untyped de boot_info en la region gestionada)
+ * @freePairs[] parejas de nodos liberadas al juntar mitades, para reutilizar
+ * @countFreePairs numero de parejas en freePairs[]
  */
-struct Regions {
-    struct Region regions[MAX_MEMORY_REGIONS];
-    int countRegions;
+struct UntypedTree {
+    struct UntypedNode nodes[MAX_UNTYPED_NODES];
+    int countNodes;
+    int countRoots;
+    int freePairs[MAX_UNTYPED_NODES / 2];
+    int countFreePairs;
 };
 
 /**
- * Lista estatica con la copia de boot_info->untypedList[] para 
- * ser ordenada por paddr, ya que no se puede modificar la original
- * @myUntypedList array con los slots de memoria libre asignada a
- *                Root_task que cumplen (isDevice == 0)
- * @countSlots contador de los slots de memoria libre
+ * Untyped de boot_info fuera de la region gestionada, de los que
+ * create_object() saca los objetos del kernel. Refleja el watermark del
+ * kernel (capFreeIndex): seL4 solo reparte hacia delante, alineando cada
+ * objeto a su tamaño, y no vuelve a empezar hasta resetear el untyped
+ * @cap capacidad del untyped
+ * @paddr direccion de inicio
+ * @sizeBits tamaño (2^sizeBits)
+ * @watermark bytes consumidos desde paddr
+ * @padding bytes perdidos en total por alineacion
+ * @countChildren objetos creados a partir del untyped
  */
-struct Slots {
-    seL4_UntypedDesc myUntypedList[CONFIG_MAX_NUM_BOOTINFO_UNTYPED_CAPS];
-    int countSlots;
+struct ObjectUntyped {
+    seL4_CPtr cap;
+    seL4_Word paddr;
+    seL4_Uint8 sizeBits;
+    seL4_Word watermark;
+    seL4_Word padding;
+    int countChildren;
+};
+
+/**
+ * Lista de untyped para objetos del kernel
+ * @untypeds[] untyped fuera de la region gestionada
+ * @countUntypeds numero de untyped en untypeds[]
+ */
+struct ObjectUntypeds {
+    struct ObjectUntyped untypeds[CONFIG_MAX_NUM_BOOTINFO_UNTYPED_CAPS];
+    int countUntypeds;
+};
+
+/**
+ * Sub-arena delegado a un cliente
+ * @client identificador del cliente (badge sin CLIENT_BADGE_FLAG)
+ * @paddr inicio del sub-arena
+ * @node nodo de untypedTree con el untyped del sub-arena
+ */
+struct SubArena {
+    seL4_Word client;
+    seL4_Word paddr;
+    int node;
+};
+
+/**
+ * Lista de sub-arenas delegados
+ * @arenas[] sub-arenas entregados
+ * @countArenas numero de sub-arenas entregados
+ */
+struct SubArenas {
+    struct SubArena arenas[MAX_SUB_ARENAS];
+    int countArenas;
+};
+
+/**
+ * Cuenta de memoria de un cliente, indexada por su badge. Un limite 0 indica
+ * que no hay limite
+ * @inUse bytes reservados directamente (allocate)
+ * @reserved bytes delegados en sub-arenas
+ * @softLimit limite blando: se puede superar, pero se avisa al cliente
+ * @hardLimit limite duro: las reservas que lo superen se rechazan
+ */
+struct ClientAccount {
+    seL4_Word inUse;
+    seL4_Word reserved;
+    seL4_Word softLimit;
+    seL4_Word hardLimit;
+};
+
+/**
+ * Estado de presion de memoria de la region gestionada
+ * @freeBytes bytes libres, actualizado en cada reserva y liberacion
+ * @lowMark por debajo se avisa a los clientes para que devuelvan memoria
+ * @highMark por encima se deja de recuperar memoria
+ * @reclaiming si se esta recuperando memoria (entre ambas marcas)
+ * @reclaimedBytes bytes liberados desde que se cruzo la marca baja
+ * @notification[] notification de aviso de cada cliente registrado
+ */
+struct MemoryPressure {
+    seL4_Word freeBytes;
+    seL4_Word lowMark;
+    seL4_Word highMark;
+    seL4_Bool reclaiming;
+    seL4_Word reclaimedBytes;
+    seL4_CPtr notification[MAX_CLIENTS];
+};
+
+/**
+ * Mapa de bits de los slots del CSpace (1 = libre), indexado por cptr. Cada
+ * bit de summary indica si la palabra correspondiente de words tiene algun
+ * slot libre
+ * @words[] un bit por slot
+ * @summary[] un bit por palabra de words
+ * @countFree numero de slots libres
+ * @hint primera palabra de summary que puede tener bits a 1
+ * @growing si se esta dentro de cspace_grow()
+ */
+struct SlotBitmap {
+    seL4_Word words[SLOT_WORDS];
+    seL4_Word summary[SLOT_SUMMARY_WORDS];
+    seL4_Word countFree;
+    seL4_Word hint;
+    seL4_Bool growing;
+};
+
+/**
+ * CSpace de Root_task. Empieza siendo solo el CNode raiz de boot_info; al
+ * crecer pasa a dos niveles: un CNode superior de 2^CSPACE_TOP_BITS slots
+ * con el CNode raiz original (sin guarda) en el slot 0 y CNodes nuevos del
+ * mismo tamaño en el resto. Un cptr queda |guarda 0|nivel 1|slot de nivel 2|
+ * y los cptr de boot_info no cambian
+ * @root capacidad para direccionar slots con profundidad seL4_WordBits
+ * @countNodes CNodes de nivel 2 enlazados (0 mientras hay un solo nivel)
+ */
+struct CSpace {
+    seL4_CPtr root;
+    int countNodes;
+};
+
+/**
+ * Pool de objetos del kernel de tamaño fijo de un tipo. Los objetos se
+ * crean de POOL_REFILL en POOL_REFILL y al devolverlos se reciclan en vez
+ * de borrarlos, para volver a entregarlos sin retype
+ * @type tipo de objeto seL4
+ * @free[] capacidades de los objetos libres (pila)
+ * @countFree numero de objetos libres
+ * @countCreated numero de objetos creados en total
+ * @used[] capacidades de los objetos entregados, las unicas que acepta pool_put()
+ * @countUsed numero de objetos entregados
+ */
+struct ObjectPool {
+    seL4_Word type;
+    seL4_CPtr free[POOL_MAX_OBJECTS];
+    int countFree;
+    int countCreated;
+    seL4_CPtr used[POOL_MAX_OBJECTS];
+    int countUsed;
+};
+
+/**
+ * Trozo de 2^n objetos creado por allocate_object() con un solo retype
+ * @first primer slot de los objetos
+ * @count numero de objetos
+ * @node nodo de untypedTree del que se han creado
+ */
+struct ObjectChunk {
+    seL4_CPtr first;
+    int count;
+    int node;
+};
+
+/**
+ * Lista de trozos de objetos entregados por allocate_object()
+ * @chunks[] trozos entregados
+ * @countChunks numero de trozos
+ */
+struct ObjectChunks {
+    struct ObjectChunk chunks[MAX_OBJECT_CHUNKS];
+    int countChunks;
+};
+
+/**
+ * Slab: pagina partida en objetos del mismo tamaño para reservas de menos
+ * de media pagina
+ * @paddr direccion de la pagina
+ * @sizeClass clase de los objetos (2^(sizeClass+SLAB_MIN_BITS) bytes), -1 si no se usa
+ * @countUsed objetos reservados
+ * @prev slab anterior con huecos de la misma clase, -1 si es el primero
+ * @next slab siguiente con huecos de la misma clase, -1 si es el ultimo
+ * @hashNext slab siguiente de la misma lista de slabCache.hash[], -1 si es el ultimo
+ * @map[] un bit por objeto (1 = reservado)
+ */
+struct Slab {
+    seL4_Word paddr;
+    int sizeClass;
+    int countUsed;
+    int prev;
+    int next;
+    int hashNext;
+    seL4_Word map[SLAB_MAP_WORDS];
+};
+
+/**
+ * Slabs de allocate_bytes()
+ * @slabs[] slabs creados
+ * @countSlabs slabs usados de slabs[]
+ * @partial[] primer slab con huecos de cada clase, -1 si no hay
+ * @freeSlabs[] indices de slabs[] sin usar, para reutilizar
+ * @countFreeSlabs numero de indices en freeSlabs[]
+ * @hash[] primer slab de cada lista, por numero de pagina, -1 si esta vacia
+ */
+struct SlabCache {
+    struct Slab slabs[MAX_SLABS];
+    int countSlabs;
+    int partial[SLAB_CLASSES];
+    int freeSlabs[MAX_SLABS];
+    int countFreeSlabs;
+    int hash[SLAB_HASH_BUCKETS];
+};
+
+/**
+ * Trozo de memoria de una reserva dispersa (allocate_extents())
+ * @paddr inicio del trozo, alineado a su tamaño
+ * @sizeBits tamaño del trozo (2^sizeBits)
+ */
+struct Extent {
+    seL4_Word paddr;
+    seL4_Uint8 sizeBits;
+};
+
+/**
+ * Lote de frames de un trozo mapeado con map_extents(). Un retype solo deja
+ * objetos en un CNode, asi que un trozo con mas de CNODE_SLOTS frames se
+ * mapea en varios lotes, cada uno con su propio untyped
+ * @client identificador del cliente que reservo el trozo
+ * @paddr inicio del lote
+ * @node nodo de untypedTree con los frames del lote
+ * @frames primer slot de los frames del lote
+ * @countFrames numero de frames del lote
+ */
+struct ExtentMap {
+    seL4_Word client;
+    seL4_Word paddr;
+    int node;
+    seL4_CPtr frames;
+    int countFrames;
+};
+
+/**
+ * Lista de lotes mapeados de todas las reservas dispersas, para poder
+ * quitarlos del VSpace al recuperar la memoria de un cliente
+ * @maps[] lotes mapeados
+ * @countMaps numero de lotes mapeados
+ */
+struct ExtentMaps {
+    struct ExtentMap maps[MAX_EXTENT_MAPS];
+    int countMaps;
+};
+
+/**
+ * Descriptor de una region reservada con allocate_handle()
+ * @paddr inicio de la region
+ * @client cliente que la reservo
+ * @sizeBits tamaño de la region (2^sizeBits)
+ * @region indice de la region en maxMemoryRegionAllocates al reservarla (pista de release_region_at())
+ * @inUse si el descriptor tiene una region reservada
+ * @generation generacion actual, cambia cada vez que se libera el descriptor
+ */
+struct Handle {
+    seL4_Word paddr;
+    seL4_Word client;
+    seL4_Uint8 sizeBits;
+    int region;
+    seL4_Bool inUse;
+    seL4_Word generation;
+};
+
+/**
+ * Tabla densa de descriptores de allocate_handle(). Un handle es
+ * (generation << HANDLE_INDEX_BITS) | indice
+ * @handles[] descriptores
+ * @countHandles descriptores usados alguna vez de handles[]
+ * @freeHandles[] indices de descriptores libres, para reutilizar
+ * @countFreeHandles numero de indices en freeHandles[]
+ */
+struct HandleTable {
+    struct Handle handles[MAX_HANDLES];
+    int countHandles;
+    int freeHandles[MAX_HANDLES];
+    int countFreeHandles;
 };
 
 const seL4_BootInfo *boot_info;
 seL4_Uint8 aligment;
 struct Regions maxMemoryRegionAllocates;
+struct SlotBitmap slotBitmap;	// slots libres del CSpace (al principio boot_info->empty)
+struct CSpace cspace;
+seL4_CPtr memServerEndpoint;	// endpoint del servidor de memoria
+seL4_CPtr memServerNotification;	// notification ligada a Root_task, timbre de los anillos
+struct ClientRings clientRings;
+struct UntypedTree untypedTree;
+struct ObjectUntypeds objectUntypeds;
+struct SubArenas subArenas;
+struct ExtentMaps extentMaps;
+struct ClientAccount accounts[MAX_CLIENTS];
+struct MemoryPressure pressure;
+struct SlabCache slabCache;
+struct HandleTable handleTable;
+struct ObjectPool objectPools[POOL_TYPES];
+struct ObjectChunks objectChunks;
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //  FUNCIONES AUXILIARES
@@ -246,17 +649,169 @@ int init_memory_system(seL4_Uint8 aligment) {
 }
 
 /**
- * Reserva la primera region de memoria alineada de tamaño 2^sizeBits
- * Politica firs fit
+ * Indica si una reserva mas de size bytes dejaria a un cliente por encima
+ * de uno de sus limites. Coste O(1)
+ * @client identificador del cliente
+ * @size bytes de la reserva (0 para saber si ya lo esta)
+ * @hard TRUE para el limite duro, FALSE para el blando
+ * @return TRUE si se supera el limite, FALSE e.o.c
+ */
+seL4_Bool account_exceeds(seL4_Word client, seL4_Word size, seL4_Bool hard) {
+
+	seL4_Word limit;
+
+	if (client >= MAX_CLIENTS)
+		return TRUE;
+	limit = hard ? accounts[client].hardLimit : accounts[client].softLimit;
+	return limit != 0 && accounts[client].inUse + accounts[client].reserved + size > limit;
+}
+
+/**
+ * Anota size bytes en la cuenta de un cliente si no supera su limite duro
+ * @client identificador del cliente
+ * @size bytes a anotar
+ * @reserved TRUE si son de un sub-arena, FALSE si son de uso directo
+ * @return 0 dentro de los limites, 1 por encima del limite blando, -1 si
+ *         supera el limite duro (no se anota)
+ */
+int account_charge(seL4_Word client, seL4_Word size, seL4_Bool reserved) {
+
+	if (account_exceeds(client, size, TRUE))
+		return -1;
+	if (reserved)
+		accounts[client].reserved += size;
+	else
+		accounts[client].inUse += size;
+	return account_exceeds(client, 0, FALSE) ? 1 : 0;
+}
+
+/**
+ * Descuenta size bytes de la cuenta de un cliente
+ * @client identificador del cliente
+ * @size bytes a descontar
+ * @reserved TRUE si son de un sub-arena, FALSE si son de uso directo
+ */
+void account_uncharge(seL4_Word client, seL4_Word size, seL4_Bool reserved) {
+
+	if (reserved)
+		accounts[client].reserved -= size;
+	else
+		accounts[client].inUse -= size;
+}
+
+/**
+ * Fija los limites de memoria de un cliente (0 = sin limite)
+ * @client identificador del cliente
+ * @softLimit limite blando en bytes
+ * @hardLimit limite duro en bytes
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int set_client_limits(seL4_Word client, seL4_Word softLimit, seL4_Word hardLimit) {
+
+	if (client >= MAX_CLIENTS)
+		return 1;
+	accounts[client].softLimit = softLimit;
+	accounts[client].hardLimit = hardLimit;
+	return 0;
+}
+
+/**
+ * Fija las marcas de memoria libre. Por debajo de lowMark se pide a los
+ * clientes que devuelvan memoria hasta volver a superar highMark
+ * @lowMark marca baja en bytes
+ * @highMark marca alta en bytes
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int set_watermarks(seL4_Word lowMark, seL4_Word highMark) {
+
+	if (lowMark > highMark)
+		return 1;
+	pressure.lowMark = lowMark;
+	pressure.highMark = highMark;
+	return 0;
+}
+
+/**
+ * Inicializa el contador de memoria libre y las marcas por defecto a partir
+ * de la region gestionada. Se llama despues de init_memory_system()
+ */
+void init_pressure(void) {
+
+	int i;
+
+	pressure.freeBytes = 0;
+	for (i = 0; i < maxMemoryRegionAllocates.countRegions; i++)
+		if (!maxMemoryRegionAllocates.regions[i].isAllocated)
+			pressure.freeBytes += maxMemoryRegionAllocates.regions[i].sizeBitsPow;
+	set_watermarks(pressure.freeBytes >> LOW_WATERMARK_SHIFT, pressure.freeBytes >> HIGH_WATERMARK_SHIFT);
+	pressure.reclaiming = FALSE;
+	pressure.reclaimedBytes = 0;
+}
+
+/**
+ * Entra en modo recuperacion (si no lo estaba ya) y avisa a todos los
+ * clientes registrados con un seL4_Signal() sobre su notification
+ */
+void pressure_reclaim(void) {
+
+	int i;
+
+	if (pressure.reclaiming)
+		return;
+	pressure.reclaiming = TRUE;
+	pressure.reclaimedBytes = 0;
+	printf("AVISO: Quedan %d bytes libres, se pide a los clientes que devuelvan memoria\n", (int) pressure.freeBytes);
+	for (i = 0; i < MAX_CLIENTS; i++)
+		if (pressure.notification[i] != seL4_CapNull)
+			seL4_Signal(pressure.notification[i]);
+}
+
+/**
+ * Descuenta una reserva de la memoria libre. Coste O(1) salvo al cruzar la
+ * marca baja
+ * @size bytes reservados
+ */
+void pressure_charge(seL4_Word size) {
+
+	pressure.freeBytes -= size;
+	if (pressure.freeBytes < pressure.lowMark)
+		pressure_reclaim();
+}
+
+/**
+ * Suma una liberacion a la memoria libre y, en modo recuperacion, a los
+ * bytes recuperados. Sale del modo al superar la marca alta
+ * @size bytes liberados
+ */
+void pressure_credit(seL4_Word size) {
+
+	pressure.freeBytes += size;
+	if (!pressure.reclaiming)
+		return;
+	pressure.reclaimedBytes += size;
+	if (pressure.freeBytes >= pressure.highMark) {
+		printf("Recuperados %d bytes, quedan %d bytes libres\n", (int) pressure.reclaimedBytes, (int) pressure.freeBytes);
+		pressure.reclaiming = FALSE;
+	}
+}
+
+/**
+ * Reserva para un cliente la primera region de memoria alineada de tamaño
+ * 2^sizeBits, si cabe en su limite duro. Politica firs fit
+ * @client identificador del cliente (ROOT_CLIENT para Root_task), con
+ * OWNER_HANDLE si la region es de un handle
  * @sizeBits tamaño de memoria a reservar
  * @return puntero a la region de memoria reservada, 0 e.o.c con msg de error
  */
-seL4_Word allocate(seL4_Uint8 sizeBits) {
+seL4_Word allocate_client(seL4_Word client, seL4_Uint8 sizeBits) {
 
-	int i = 0, j;
-	seL4_Word mask, paddr;
-	unsigned int sizeBitsPow = 2<<(sizeBits-1);
+	seL4_Word mask, paddr, account = client & ~OWNER_HANDLE;
+	unsigned int sizeBitsPow = (seL4_Word) 1 << sizeBits;
 
+	if (account_charge(account, sizeBitsPow, FALSE) < 0) {
+		printf("ERROR: allocate(%d) supera el limite del cliente %d\n", (int) sizeBits, (int) account);
+		return 0;
+	}
 	// define mascara a usar
 	if (aligment == 64)
 		mask = 7;
@@ -266,92 +821,70 @@ seL4_Word allocate(seL4_Uint8 sizeBits) {
 		mask = 1;
 	else
 		mask = 0;
-	// mientras quedan regiones posibles
-	while (i<maxMemoryRegionAllocates.countRegions) {
-		// buscar la rimera region libre (first fit con isAllocated = false) 
-		while (maxMemoryRegionAllocates.regions[i].isAllocated || maxMemoryRegionAllocates.regions[i].sizeBitsPow < sizeBitsPow)
-			i++;
-		// coger si direccion de memoria
-		paddr = maxMemoryRegionAllocates.regions[i].paddr;
-		// mientras no este alineado, avanzar la direccion
-		while ((paddr & mask) != 0)
-			paddr++;
-		// Con direccion alineada, si hay espacio suficiente para reservar, efectuar reserva
-		if ((paddr - maxMemoryRegionAllocates.regions[i].paddr) <= (maxMemoryRegionAllocates.regions[i].sizeBitsPow - sizeBitsPow)) {
-			// si la direccion de inicio de region es alineada
-			if (paddr == maxMemoryRegionAllocates.regions[i].paddr) {
-				// si es de tamaño exacto la refion y el solicitado, no quedan restos libres de la region
-				if (maxMemoryRegionAllocates.regions[i].sizeBitsPow == sizeBitsPow){
-					// marcar como allocated y devolver el puntero, no hace falta trocear |region i tamano 2^sizeBits reservada|
-					maxMemoryRegionAllocates.regions[i].isAllocated = TRUE;
-				} else {
-					// dividir en la region a reservar y el resto de la region libre |region i tamano 2^sizeBits reservada|nueva region i+1 del resto (maxMemoryRegionAllocates.regions[i].sizeBitsPow - 2^sizeBits) no reservada|
-					for (j = maxMemoryRegionAllocates.countRegions; j>i+1; j--) {
-						// copia de las regiones siguientes una posicion adelante
-						maxMemoryRegionAllocates.regions[j].paddr = maxMemoryRegionAllocates.regions[j-1].paddr;
-						maxMemoryRegionAllocates.regions[j].sizeBitsPow = maxMemoryRegionAllocates.regions[j-1].sizeBitsPow;
-						maxMemoryRegionAllocates.regions[j].isAllocated = maxMemoryRegionAllocates.regions[j-1].isAllocated;
-					}
-					// region resto a la derecha
-					maxMemoryRegionAllocates.regions[i+1].paddr = maxMemoryRegionAllocates.regions[i].paddr + sizeBitsPow;
-					maxMemoryRegionAllocates.regions[i+1].sizeBitsPow = maxMemoryRegionAllocates.regions[i].sizeBitsPow - sizeBitsPow;
-					maxMemoryRegionAllocates.regions[i+1].isAllocated = FALSE;
-					// region reservada
-					//maxMemoryRegionAllocates.regions[i+1].paddr = paddr; //same
-					maxMemoryRegionAllocates.regions[i].sizeBitsPow = sizeBitsPow;
-					maxMemoryRegionAllocates.regions[i].isAllocated = TRUE;
-					// aumenta contador de regiones
-					maxMemoryRegionAllocates.countRegions++;
-				}
-			} else if ((paddr - maxMemoryRegionAllocates.regions[i].paddr) == (maxMemoryRegionAllocates.regions[i].sizeBitsPow - sizeBitsPow)) {
-				// la seccion a reservar esta desde un punto medio de la region hasta el final, dejando resto parte libre a la izda
-				// |region i del resto (maxMemoryRegionAllocates.regions[i].sizeBitsPow - 2^sizeBits) no reservada|nueva region i+1 tamano 2^sizeBits reservada|
-				for (j = maxMemoryRegionAllocates.countRegions; j>i+1; j--) {
-					// copia de las regiones siguientes una posicion adelante
-					maxMemoryRegionAllocates.regions[j].paddr = maxMemoryRegionAllocates.regions[j-1].paddr;
-					maxMemoryRegionAllocates.regions[j].sizeBitsPow = maxMemoryRegionAllocates.regions[j-1].sizeBitsPow;
-					maxMemoryRegionAllocates.regions[j].isAllocated = maxMemoryRegionAllocates.regions[j-1].isAllocated;
-				}
-				// region reservada
-				maxMemoryRegionAllocates.regions[i+1].paddr = paddr;
-				maxMemoryRegionAllocates.regions[i+1].sizeBitsPow = sizeBitsPow;
-				maxMemoryRegionAllocates.regions[i+1].isAllocated = TRUE;
-				// region resto a la izda
-				maxMemoryRegionAllocates.regions[i].sizeBitsPow -= sizeBitsPow;
-				maxMemoryRegionAllocates.regions[i].isAllocated = FALSE;
-				// aumenta contador de regiones
-				maxMemoryRegionAllocates.countRegions++;
-			} else {
-				// la seccion a reservar es un trozo en punto medio de la region con restos libres a la izda y dcha
-				// |region i del resto (maxMemoryRegionAllocates.regions[i].sizeBitsPow - 2^sizeBits - [i+2].sizeBitsPow) no reservada|nueva region i+1 tamano 2^sizeBits reservada|region i+2 del resto (maxMemoryRegionAllocates.regions[i].sizeBitsPow - 2^sizeBits - [i].sizeBitsPow) no reservada|
-				for (j = maxMemoryRegionAllocates.countRegions+1; j>i+2; j--) {
-					// copia de las regiones siguientes dos posiciones adelante
-					maxMemoryRegionAllocates.regions[j].paddr = maxMemoryRegionAllocates.regions[j-2].paddr;
-					maxMemoryRegionAllocates.regions[j].sizeBitsPow = maxMemoryRegionAllocates.regions[j-2].sizeBitsPow;
-					maxMemoryRegionAllocates.regions[j].isAllocated = maxMemoryRegionAllocates.regions[j-2].isAllocated;
-				}
-				// region resto a la derecha
-				maxMemoryRegionAllocates.regions[i+2].paddr = paddr + sizeBitsPow;
-				maxMemoryRegionAllocates.regions[i+2].sizeBitsPow = maxMemoryRegionAllocates.regions[i].sizeBitsPow - (maxMemoryRegionAllocates.regions[i+2].paddr - maxMemoryRegionAllocates.regions[i].paddr);
-				maxMemoryRegionAllocates.regions[i+2].isAllocated = FALSE;
-				// region reservada
-				maxMemoryRegionAllocates.regions[i+1].paddr = paddr;
-				maxMemoryRegionAllocates.regions[i+1].sizeBitsPow = sizeBitsPow;
-				maxMemoryRegionAllocates.regions[i+1].isAllocated = TRUE;
-				// region resto a la izda
-				maxMemoryRegionAllocates.regions[i].sizeBitsPow = maxMemoryRegionAllocates.regions[i].sizeBitsPow - sizeBitsPow - maxMemoryRegionAllocates.regions[i+2].sizeBitsPow;
-				maxMemoryRegionAllocates.regions[i].isAllocated = FALSE;
-				// aumenta contador de regiones
-				maxMemoryRegionAllocates.countRegions += 2;
-			}
-			return paddr;
-		} else {
-			// seguir buscando a partir de la siguiente region si existe
-			i++;
-		}
+	paddr = allocate_region(&maxMemoryRegionAllocates, sizeBitsPow, mask, client);
+	if (paddr == 0) {
+		account_uncharge(account, sizeBitsPow, FALSE);
+		printf("ERROR: No se ha podido efectuar la reserva de memoria allocate(%d)\n", (int) sizeBits);
+		pressure_reclaim();
+	} else {
+		pressure_charge(sizeBitsPow);
 	}
-	printf("ERROR: No se ha podido efectuar la reserva de memoria allocate(%d)\n", (int) sizeBits);
-	return 0;
+	return paddr;
+}
+
+/**
+ * Reserva la primera region de memoria alineada de tamaño 2^sizeBits
+ * Politica firs fit
+ * @sizeBits tamaño de memoria a reservar
+ * @return puntero a la region de memoria reservada, 0 e.o.c con msg de error
+ */
+seL4_Word allocate(seL4_Uint8 sizeBits) {
+
+	return allocate_client(ROOT_CLIENT, sizeBits);
+}
+
+/**
+ * Reserva la primera region de memoria de tamaño 2^sizeBits alineada a su
+ * propio tamaño, como necesita un untyped de seL4. No se anota en ninguna
+ * cuenta: lo hace quien la pide
+ * @sizeBits tamaño de memoria a reservar
+ * @owner propietario de la region
+ * @return puntero a la region de memoria reservada, 0 e.o.c con msg de error
+ */
+seL4_Word allocate_aligned(seL4_Uint8 sizeBits, seL4_Word owner) {
+
+	seL4_Word paddr;
+
+	paddr = allocate_region(&maxMemoryRegionAllocates, (seL4_Word) 1 << sizeBits, ((seL4_Word) 1 << sizeBits) - 1, owner);
+	if (paddr == 0) {
+		printf("ERROR: No se ha podido efectuar la reserva de memoria allocate_aligned(%d)\n", (int) sizeBits);
+		pressure_reclaim();
+	} else {
+		pressure_charge((seL4_Word) 1 << sizeBits);
+	}
+	return paddr;
+}
+
+/**
+ * Libera una region de memoria de un cliente y la descuenta de su cuenta.
+ * Las regiones con una marca OWNER_TAGS en el owner no coinciden con el
+ * cliente y se rechazan: solo las libera su propia funcion
+ * @client identificador del cliente que la reservo, con OWNER_SLAB si es
+ * la pagina de un slab
+ * @paddr puntero al inicio de la region de memoria a librerar
+ * @return 0 en ejecucion correcta, cogigo de error e.o.c
+ */
+int release_client(seL4_Word client, seL4_Word paddr) {
+
+	int error;
+	unsigned int size;
+
+	error = release_region(&maxMemoryRegionAllocates, paddr, client, &size);
+	if (error == 0) {
+		account_uncharge(client & ~OWNER_SLAB, size, FALSE);
+		pressure_credit(size);
+	}
+	return error;
 }
 
 /**
@@ -361,110 +894,2522 @@ seL4_Word allocate(seL4_Uint8 sizeBits) {
  */
 int release(seL4_Word paddr) {
 
-	int i = 0, j;
+	return release_client(ROOT_CLIENT, paddr);
+}
 
-	// avanzar hasta encontrar la region reservada a liberar dentro de maxMemoryRegionAllocates.regions[]
-	while (paddr != maxMemoryRegionAllocates.regions[i].paddr && i < maxMemoryRegionAllocates.countRegions)
-		i++;
-	// si no encuentra esa region, error
-	if (i == maxMemoryRegionAllocates.countRegions) {
-		printf("ERROR: El puntero 0x%08x no pertenece a ninguna region\n", (unsigned int) paddr);
-		return 1;
+/**
+ * Libera una region de un cliente de la que se conoce el tamaño. Si el
+ * tamaño no coincide con el reservado no se libera nada. La region se
+ * busca igual que en release_client(): el tamaño solo se comprueba
+ * @client identificador del cliente que la reservo
+ * @paddr puntero al inicio de la region de memoria a librerar
+ * @sizeBits tamaño con el que se reservo (2^sizeBits)
+ * @return 0 en ejecucion correcta, cogigo de error e.o.c
+ */
+int release_sized_client(seL4_Word client, seL4_Word paddr, seL4_Uint8 sizeBits) {
+
+	int error;
+	seL4_Word size = (seL4_Word) 1 << sizeBits;
+
+	error = release_region_sized(&maxMemoryRegionAllocates, paddr, client, size);
+	if (error == 0) {
+		account_uncharge(client, size, FALSE);
+		pressure_credit(size);
 	}
-	// si la region estaya libre, error
-	if (!maxMemoryRegionAllocates.regions[i].isAllocated) {
-		printf("ERROR: El puntero 0x%08x pertenece region libre\n", (unsigned int) paddr);
-		return 2;
+	return error;
+}
+
+/**
+ * Libera la region de memoria de tamaño 2^sizeBits apuntada por paddr
+ * @paddr puntero al inicio de la region de memoria a librerar
+ * @sizeBits tamaño pasado a allocate()
+ * @return 0 en ejecucion correcta, cogigo de error e.o.c
+ */
+int release_sized(seL4_Word paddr, seL4_Uint8 sizeBits) {
+
+	return release_sized_client(ROOT_CLIENT, paddr, sizeBits);
+}
+
+/**
+ * Cambia a 2^sizeBits sin moverla una region de un cliente: crece sobre la
+ * region libre contigua o devuelve la cola sobrante. Si no puede crecer, el
+ * cliente debe reservar otra region, copiar y liberar esta. Solo cambia
+ * regiones de allocate(): los sub-arenas, los trozos de reservas dispersas,
+ * las regiones de handles y las paginas de slabs llevan una marca
+ * OWNER_TAGS y se cuentan aparte, asi que se rechazan igual que las de otro
+ * cliente
+ * @client identificador del cliente que la reservo, sin marcas
+ * @paddr puntero al inicio de la region
+ * @sizeBits nuevo tamaño de la region, como mucho 31
+ * @return 0 en ejecucion correcta, 3 si la region no es de allocate() del
+ * cliente, 4 si no hay sitio contiguo, 6 si supera el limite del cliente,
+ * 7 si sizeBits no es valido, otro cogigo de error de resize_region() e.o.c
+ */
+int resize_client(seL4_Word client, seL4_Word paddr, seL4_Uint8 sizeBits) {
+
+	int error;
+	unsigned int size, oldSize;
+
+	if (client & OWNER_TAGS)
+		return 3;
+	// el tamaño de una region es un unsigned int
+	if (sizeBits > 31) {
+		printf("ERROR: resize(0x%08x, %d) tamaño no valido\n", (unsigned int) paddr, (int) sizeBits);
+		return 7;
 	}
-	// si es la primera region de maxMemoryRegionAllocates.regions[]
-	if (i == 0) {
-		if (maxMemoryRegionAllocates.countRegions > 1 && !maxMemoryRegionAllocates.regions[i+1].isAllocated) { // |i=0 reservado|i+1 libre|...|
-			// juntar regiones i, i+1
-			maxMemoryRegionAllocates.regions[i].sizeBitsPow += maxMemoryRegionAllocates.regions[i+1].sizeBitsPow;
-			maxMemoryRegionAllocates.regions[i].isAllocated = FALSE;
-			maxMemoryRegionAllocates.countRegions--;
-			for (j=i+1; j<maxMemoryRegionAllocates.countRegions; j++) {
-				// mueve de las regiones siguientes una posicion atras
-				maxMemoryRegionAllocates.regions[j].paddr = maxMemoryRegionAllocates.regions[j+1].paddr;
-				maxMemoryRegionAllocates.regions[j].sizeBitsPow = maxMemoryRegionAllocates.regions[j+1].sizeBitsPow;
-				maxMemoryRegionAllocates.regions[j].isAllocated = maxMemoryRegionAllocates.regions[j+1].isAllocated;
-			}
-		} else { // |i=0 reservado|i+1 reservado|...| o // |i=0 reservado|...vacio...|
-			maxMemoryRegionAllocates.regions[i].isAllocated = FALSE;
-		}
-	} else if (i == maxMemoryRegionAllocates.countRegions-1) {
-		// si es la ultima region de maxMemoryRegionAllocates.regions[]
-		if (!maxMemoryRegionAllocates.regions[i-1].isAllocated) { // |...|i-1 libre|i reservado|
-			// juntar regiones i-1, i
-			maxMemoryRegionAllocates.regions[i-1].sizeBitsPow += maxMemoryRegionAllocates.regions[i].sizeBitsPow;
-			maxMemoryRegionAllocates.countRegions--;
-		} else { // |...|i-1 reservado|i reservado|
-			maxMemoryRegionAllocates.regions[i].isAllocated = FALSE;
-		}
+	size = (seL4_Word) 1 << sizeBits;
+	error = resize_region(&maxMemoryRegionAllocates, paddr, client, size, &oldSize);
+	if (error != 0 || size == oldSize)
+		return error;
+	if (size < oldSize) {
+		account_uncharge(client, oldSize - size, FALSE);
+		pressure_credit(oldSize - size);
+	} else if (account_charge(client, size - oldSize, FALSE) < 0) {
+		// la cola que acaba de coger vuelve a la region libre de la dcha
+		resize_region(&maxMemoryRegionAllocates, paddr, client, oldSize, NULL);
+		printf("ERROR: resize(0x%08x, %d) supera el limite del cliente %d\n", (unsigned int) paddr, (int) sizeBits, (int) client);
+		return 6;
 	} else {
-		// si es una region intermedia
-		// si la izda y la dcha estan reservadas, liberar y terminar
-		if (maxMemoryRegionAllocates.regions[i-1].isAllocated && maxMemoryRegionAllocates.regions[i+1].isAllocated) { // |...|i-1 reservado|i reservado|i+1 reservado|...|
-			maxMemoryRegionAllocates.regions[i].isAllocated = FALSE;
-		} else if (!maxMemoryRegionAllocates.regions[i-1].isAllocated && !maxMemoryRegionAllocates.regions[i+1].isAllocated) { // |...|i-1 libre|i reservado|i+1 libre|...|
-			// si la izda y la dcha estan libres, liberar, juntar y terminar
-			// sumar espacio de las tres regiones
-			maxMemoryRegionAllocates.regions[i-1].sizeBitsPow = maxMemoryRegionAllocates.regions[i-1].sizeBitsPow + maxMemoryRegionAllocates.regions[i].sizeBitsPow + maxMemoryRegionAllocates.regions[i+1].sizeBitsPow;
-			// reducir contador de regiones en 2
-			maxMemoryRegionAllocates.countRegions -= 2;
-			for (j=i; j<maxMemoryRegionAllocates.countRegions; j++) {
-				// mueve de las regiones siguientes dos posiciones atras
-				maxMemoryRegionAllocates.regions[j].paddr = maxMemoryRegionAllocates.regions[j+2].paddr;
-				maxMemoryRegionAllocates.regions[j].sizeBitsPow = maxMemoryRegionAllocates.regions[j+2].sizeBitsPow;
-				maxMemoryRegionAllocates.regions[j].isAllocated = maxMemoryRegionAllocates.regions[j+2].isAllocated;
-			}
-		} else if (maxMemoryRegionAllocates.regions[i-1].isAllocated && !maxMemoryRegionAllocates.regions[i+1].isAllocated) { // |...|i-1 reservado|i reservado|i+1 libre|...|
-			// juntar regiones i, i+1
-			maxMemoryRegionAllocates.regions[i].sizeBitsPow += maxMemoryRegionAllocates.regions[i+1].sizeBitsPow;
-			maxMemoryRegionAllocates.regions[i].isAllocated = FALSE;
-			maxMemoryRegionAllocates.countRegions--;
-			for (j=i+1; j<maxMemoryRegionAllocates.countRegions; j++) {
-				// mueve de las regiones siguientes una posicion atras
-				maxMemoryRegionAllocates.regions[j].paddr = maxMemoryRegionAllocates.regions[j+1].paddr;
-				maxMemoryRegionAllocates.regions[j].sizeBitsPow = maxMemoryRegionAllocates.regions[j+1].sizeBitsPow;
-				maxMemoryRegionAllocates.regions[j].isAllocated = maxMemoryRegionAllocates.regions[j+1].isAllocated;
-			}
-		} else { // |...|i-1 libre|i reservado|i+1 reservado|...|
-			// juntar regiones i-1, i
-			maxMemoryRegionAllocates.regions[i-1].sizeBitsPow += maxMemoryRegionAllocates.regions[i].sizeBitsPow;
-			maxMemoryRegionAllocates.regions[i-1].isAllocated = FALSE;
-			maxMemoryRegionAllocates.countRegions--;
-			for (j=i; j<maxMemoryRegionAllocates.countRegions; j++) {
-				// mueve de las regiones siguientes una posicion atras
-				maxMemoryRegionAllocates.regions[j].paddr = maxMemoryRegionAllocates.regions[j+1].paddr;
-				maxMemoryRegionAllocates.regions[j].sizeBitsPow = maxMemoryRegionAllocates.regions[j+1].sizeBitsPow;
-				maxMemoryRegionAllocates.regions[j].isAllocated = maxMemoryRegionAllocates.regions[j+1].isAllocated;
-			}
-		}
+		pressure_charge(size - oldSize);
 	}
 	return 0;
 }
 
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//  MAIN - PRUEBAS DE EJECUCION
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
 /**
- * Programa de pruebas
- * @return 0 en ejecucion correcta, !0 e.o.c
+ * Cambia a 2^sizeBits sin moverla una region reservada con allocate()
+ * @paddr puntero al inicio de la region
+ * @sizeBits nuevo tamaño de la region
+ * @return 0 en ejecucion correcta, 4 si no hay sitio contiguo, cogigo de error e.o.c
  */
-int main(void) {
+int resize(seL4_Word paddr, seL4_Uint8 sizeBits) {
 
-	int i;
+	return resize_client(ROOT_CLIENT, paddr, sizeBits);
+}
 
-    printf("\n\n>>>\n>>> Welcome to the SESO operating system\n>>>\n");
-    printf("============================================================\n");
+/**
+ * Reserva para un cliente una tira de paginas de size bytes redondeado a
+ * 4 KiB (no a la siguiente potencia de 2), alineada a pagina
+ * @client identificador del cliente, con OWNER_SLAB si es la pagina de un slab
+ * @size tamaño en bytes, de 1 a UINT_MAX redondeado a pagina
+ * @return puntero a la region reservada, 0 e.o.c con msg de error
+ */
+seL4_Word allocate_pages(seL4_Word client, seL4_Word size) {
 
-    boot_info = platsupport_get_bootinfo();
+	seL4_Word paddr, account = client & ~OWNER_SLAB, pageMask = ((seL4_Word) 1 << seL4_PageBits) - 1;
+
+	// la lista de regiones guarda tamaños de unsigned int
+	if (size == 0 || size > (UINT_MAX & ~pageMask)) {
+		printf("ERROR: allocate_pages(%lu) tamaño no valido\n", (unsigned long) size);
+		return 0;
+	}
+	size = (size + pageMask) & ~pageMask;
+	if (account_charge(account, size, FALSE) < 0) {
+		printf("ERROR: allocate_pages(%lu) supera el limite del cliente %d\n", (unsigned long) size, (int) account);
+		return 0;
+	}
+	paddr = allocate_region(&maxMemoryRegionAllocates, size, pageMask, client);
+	if (paddr == 0) {
+		account_uncharge(account, size, FALSE);
+		printf("ERROR: No se ha podido efectuar la reserva de memoria allocate_pages(%lu)\n", (unsigned long) size);
+		pressure_reclaim();
+	} else {
+		pressure_charge(size);
+	}
+	return paddr;
+}
+
+/**
+ * Inicializa los slabs de allocate_bytes() sin ningun slab creado
+ */
+void init_slabs(void) {
+
+	int i;
+
+	slabCache.countSlabs = 0;
+	slabCache.countFreeSlabs = 0;
+	for (i = 0; i < SLAB_CLASSES; i++)
+		slabCache.partial[i] = -1;
+	for (i = 0; i < SLAB_HASH_BUCKETS; i++)
+		slabCache.hash[i] = -1;
+}
+
+/**
+ * Lista de slabCache.hash[] en la que va el slab de una pagina
+ * @paddr direccion dentro de la pagina
+ * @return indice en slabCache.hash[]
+ */
+int slab_hash(seL4_Word paddr) {
+
+	return (paddr >> seL4_PageBits) % SLAB_HASH_BUCKETS;
+}
+
+/**
+ * Clase de slab para un tamaño de hasta SLAB_MAX_SIZE bytes
+ * @size tamaño en bytes
+ * @return indice de clase (objetos de 2^(clase+SLAB_MIN_BITS) bytes)
+ */
+int slab_class(seL4_Word size) {
+
+	int bits = SLAB_MIN_BITS;
+
+	while (((seL4_Word) 1 << bits) < size)
+		bits++;
+	return bits - SLAB_MIN_BITS;
+}
+
+/**
+ * Saca un slab de la lista de slabs con huecos de su clase
+ * @s indice del slab
+ */
+void slab_unlink(int s) {
+
+	struct Slab *slab = &slabCache.slabs[s];
+
+	if (slab->prev >= 0)
+		slabCache.slabs[slab->prev].next = slab->next;
+	else
+		slabCache.partial[slab->sizeClass] = slab->next;
+	if (slab->next >= 0)
+		slabCache.slabs[slab->next].prev = slab->prev;
+}
+
+/**
+ * Pone un slab al principio de la lista de slabs con huecos de su clase
+ * @s indice del slab
+ */
+void slab_link(int s) {
+
+	struct Slab *slab = &slabCache.slabs[s];
+
+	slab->prev = -1;
+	slab->next = slabCache.partial[slab->sizeClass];
+	if (slab->next >= 0)
+		slabCache.slabs[slab->next].prev = s;
+	slabCache.partial[slab->sizeClass] = s;
+}
+
+/**
+ * Crea un slab vacio de una clase sobre una pagina nueva
+ * @sizeClass clase del slab
+ * @return indice del slab, -1 e.o.c
+ */
+int slab_create(int sizeClass) {
+
+	int s, k, objects = SLAB_OBJECTS(sizeClass);
+	seL4_Word paddr;
+	struct Slab *slab;
+
+	if (slabCache.countFreeSlabs == 0 && slabCache.countSlabs == MAX_SLABS) {
+		printf("ERROR: No se pueden crear mas de %d slabs\n", MAX_SLABS);
+		return -1;
+	}
+	// con OWNER_SLAB la pagina no se puede liberar con release() mientras tenga objetos
+	paddr = allocate_pages(ROOT_CLIENT | OWNER_SLAB, (seL4_Word) 1 << seL4_PageBits);
+	if (paddr == 0)
+		return -1;
+	s = slabCache.countFreeSlabs > 0 ? slabCache.freeSlabs[--slabCache.countFreeSlabs] : slabCache.countSlabs++;
+	slab = &slabCache.slabs[s];
+	slab->paddr = paddr;
+	slab->sizeClass = sizeClass;
+	slab->countUsed = 0;
+	slab->hashNext = slabCache.hash[slab_hash(paddr)];
+	slabCache.hash[slab_hash(paddr)] = s;
+	// los bits que no corresponden a ningun objeto quedan siempre ocupados
+	for (k = 0; k < SLAB_MAP_WORDS; k++) {
+		if (objects >= (k + 1) * seL4_WordBits)
+			slab->map[k] = 0;
+		else if (objects > k * seL4_WordBits)
+			slab->map[k] = ~(seL4_Word) 0 << (objects - k * seL4_WordBits);
+		else
+			slab->map[k] = ~(seL4_Word) 0;
+	}
+	slab_link(s);
+	return s;
+}
+
+/**
+ * Reserva size bytes con la menor perdida: hasta SLAB_MAX_SIZE, un objeto
+ * del slab de su clase (potencia de 2 desde 16 bytes, alineado a su
+ * tamaño); por encima, una tira de paginas
+ * @size tamaño en bytes, mayor que 0
+ * @return puntero a la memoria reservada, 0 e.o.c con msg de error
+ */
+seL4_Word allocate_bytes(seL4_Word size) {
+
+	int s, w, bit, sizeClass;
+	struct Slab *slab;
+
+	if (size == 0) {
+		printf("ERROR: allocate_bytes(0) no es una reserva valida\n");
+		return 0;
+	}
+	if (size > SLAB_MAX_SIZE)
+		return allocate_pages(ROOT_CLIENT, size);
+	sizeClass = slab_class(size);
+	s = slabCache.partial[sizeClass];
+	if (s < 0 && (s = slab_create(sizeClass)) < 0)
+		return 0;
+	slab = &slabCache.slabs[s];
+	for (w = 0; slab->map[w] == ~(seL4_Word) 0; w++)
+		;
+	bit = __builtin_ctzl(~slab->map[w]);
+	slab->map[w] |= (seL4_Word) 1 << bit;
+	slab->countUsed++;
+	if (slab->countUsed == SLAB_OBJECTS(sizeClass))
+		slab_unlink(s);
+	return slab->paddr + (((seL4_Word) w * seL4_WordBits + bit) << (sizeClass + SLAB_MIN_BITS));
+}
+
+/**
+ * Busca el slab que contiene paddr en la lista de su pagina, sin recorrer
+ * todos los slabs
+ * @paddr direccion dentro del slab
+ * @return indice del slab, -1 si paddr no esta en ningun slab
+ */
+int slab_find(seL4_Word paddr) {
+
+	int s;
+	seL4_Word page = paddr & ~(((seL4_Word) 1 << seL4_PageBits) - 1);
+
+	for (s = slabCache.hash[slab_hash(page)]; s >= 0; s = slabCache.slabs[s].hashNext)
+		if (slabCache.slabs[s].paddr == page)
+			return s;
+	return -1;
+}
+
+/**
+ * Libera un objeto de un slab. Si el slab queda vacio se devuelve su pagina
+ * @s indice del slab
+ * @paddr direccion del objeto
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int slab_free(int s, seL4_Word paddr) {
+
+	int *link;
+	struct Slab *slab = &slabCache.slabs[s];
+	seL4_Word offset = paddr - slab->paddr;
+	seL4_Word index = offset >> (slab->sizeClass + SLAB_MIN_BITS);
+	seL4_Word bit = (seL4_Word) 1 << (index % seL4_WordBits);
+
+	if ((offset & ((((seL4_Word) 1) << (slab->sizeClass + SLAB_MIN_BITS)) - 1)) || !(slab->map[index / seL4_WordBits] & bit)) {
+		printf("ERROR: El puntero 0x%08x no es un objeto reservado del slab\n", (unsigned int) paddr);
+		return 1;
+	}
+	// un slab lleno vuelve a tener huecos
+	if (slab->countUsed == SLAB_OBJECTS(slab->sizeClass))
+		slab_link(s);
+	slab->map[index / seL4_WordBits] &= ~bit;
+	slab->countUsed--;
+	if (slab->countUsed == 0) {
+		slab_unlink(s);
+		for (link = &slabCache.hash[slab_hash(slab->paddr)]; *link != s; link = &slabCache.slabs[*link].hashNext)
+			;
+		*link = slab->hashNext;
+		release_client(ROOT_CLIENT | OWNER_SLAB, slab->paddr);
+		slab->sizeClass = -1;
+		slabCache.freeSlabs[slabCache.countFreeSlabs++] = s;
+	}
+	return 0;
+}
+
+/**
+ * Libera memoria reservada con allocate_bytes(). Las tiras de paginas solo
+ * cuestan una busqueda en la lista de su pagina; con release_bytes_sized()
+ * ni siquiera se buscan entre los slabs
+ * @paddr puntero devuelto por allocate_bytes()
+ * @return 0 en ejecucion correcta, cogigo de error e.o.c
+ */
+int release_bytes(seL4_Word paddr) {
+
+	int s = slab_find(paddr);
+
+	if (s >= 0)
+		return slab_free(s, paddr);
+	return release_client(ROOT_CLIENT, paddr);
+}
+
+/**
+ * Inicializa la tabla de handles sin ningun descriptor usado
+ */
+void init_handles(void) {
+
+	handleTable.countHandles = 0;
+	handleTable.countFreeHandles = 0;
+}
+
+/**
+ * Reserva para un cliente una region de 2^sizeBits como allocate_client() y
+ * devuelve un handle en vez de su paddr
+ * @client identificador del cliente (ROOT_CLIENT para Root_task)
+ * @sizeBits tamaño de memoria a reservar
+ * @return handle de la region, 0 e.o.c con msg de error
+ */
+seL4_Word allocate_handle_client(seL4_Word client, seL4_Uint8 sizeBits) {
+
+	int i;
+	seL4_Word paddr;
+	struct Handle *handle;
+
+	if (handleTable.countFreeHandles == 0 && handleTable.countHandles == MAX_HANDLES) {
+		printf("ERROR: No quedan handles libres\n");
+		return 0;
+	}
+	// con OWNER_HANDLE la region solo se puede liberar por su handle
+	paddr = allocate_client(client | OWNER_HANDLE, sizeBits);
+	if (paddr == 0)
+		return 0;
+	if (handleTable.countFreeHandles > 0) {
+		i = handleTable.freeHandles[--handleTable.countFreeHandles];
+	} else {
+		i = handleTable.countHandles++;
+		// la generacion empieza en 1 para que ningun handle valga 0
+		handleTable.handles[i].generation = 1;
+	}
+	handle = &handleTable.handles[i];
+	handle->paddr = paddr;
+	handle->client = client;
+	handle->sizeBits = sizeBits;
+	handle->region = region_index(&maxMemoryRegionAllocates, paddr);
+	handle->inUse = TRUE;
+	return (handle->generation << HANDLE_INDEX_BITS) | i;
+}
+
+/**
+ * Reserva una region de 2^sizeBits y devuelve su handle
+ * @sizeBits tamaño de memoria a reservar
+ * @return handle de la region, 0 e.o.c con msg de error
+ */
+seL4_Word allocate_handle(seL4_Uint8 sizeBits) {
+
+	return allocate_handle_client(ROOT_CLIENT, sizeBits);
+}
+
+/**
+ * Descriptor vivo de un handle, con un solo acceso a la tabla. Un handle ya
+ * liberado (o inventado) no coincide en la generacion
+ * @client cliente que debe haber reservado la region
+ * @h handle devuelto por allocate_handle()
+ * @return descriptor del handle, NULL si no es valido
+ */
+struct Handle *handle_get(seL4_Word client, seL4_Word h) {
+
+	seL4_Word i = h & (((seL4_Word) 1 << HANDLE_INDEX_BITS) - 1);
+	struct Handle *handle;
+
+	if (i >= (seL4_Word) handleTable.countHandles)
+		return NULL;
+	handle = &handleTable.handles[i];
+	if (!handle->inUse || handle->generation != h >> HANDLE_INDEX_BITS || handle->client != client)
+		return NULL;
+	return handle;
+}
+
+/**
+ * Direccion fisica de la region de un handle de Root_task
+ * @h handle devuelto por allocate_handle()
+ * @return paddr de la region, 0 si el handle no es valido
+ */
+seL4_Word handle_paddr(seL4_Word h) {
+
+	struct Handle *handle = handle_get(ROOT_CLIENT, h);
+
+	return handle != NULL ? handle->paddr : 0;
+}
+
+/**
+ * Devuelve un descriptor a la pila de libres con la generacion siguiente,
+ * lo que invalida el handle y todas sus copias
+ * @handle descriptor en uso
+ */
+void handle_free(struct Handle *handle) {
+
+	handle->inUse = FALSE;
+	// al dar la vuelta se salta la generacion 0
+	handle->generation = (handle->generation + 1) & (((seL4_Word) 1 << (seL4_WordBits - HANDLE_INDEX_BITS)) - 1);
+	if (handle->generation == 0)
+		handle->generation = 1;
+	handleTable.freeHandles[handleTable.countFreeHandles++] = handle - handleTable.handles;
+}
+
+/**
+ * Invalida todos los handles de un cliente sin liberar sus regiones, que
+ * libera quien llama (reclaim_client())
+ * @client identificador del cliente
+ */
+void handle_drop_client(seL4_Word client) {
+
+	int i;
+
+	for (i = 0; i < handleTable.countHandles; i++)
+		if (handleTable.handles[i].inUse && handleTable.handles[i].client == client)
+			handle_free(&handleTable.handles[i]);
+}
+
+/**
+ * Libera la region de un handle de un cliente. El descriptor guarda el
+ * tamaño y el indice de la region, de modo que mientras la lista no se haya
+ * movido la region se libera sin buscarla. Cambiar la generacion invalida
+ * el handle y todas sus copias
+ * @client identificador del cliente que la reservo
+ * @h handle devuelto por allocate_handle()
+ * @return 0 en ejecucion correcta, cogigo de error e.o.c
+ */
+int release_handle_client(seL4_Word client, seL4_Word h) {
+
+	int error;
+	struct Handle *handle = handle_get(client, h);
+
+	if (handle == NULL) {
+		printf("ERROR: El handle 0x%08x no es valido o ya se ha liberado\n", (unsigned int) h);
+		return 1;
+	}
+	error = release_region_at(&maxMemoryRegionAllocates, handle->region, handle->paddr, client | OWNER_HANDLE, (seL4_Word) 1 << handle->sizeBits);
+	if (error != 0)
+		return error;
+	account_uncharge(client, (seL4_Word) 1 << handle->sizeBits, FALSE);
+	pressure_credit((seL4_Word) 1 << handle->sizeBits);
+	handle_free(handle);
+	return 0;
+}
+
+/**
+ * Libera la region de un handle de Root_task
+ * @h handle devuelto por allocate_handle()
+ * @return 0 en ejecucion correcta, cogigo de error e.o.c
+ */
+int release_handle(seL4_Word h) {
+
+	return release_handle_client(ROOT_CLIENT, h);
+}
+
+/**
+ * Libera memoria reservada con allocate_bytes() cuando se conoce su tamaño:
+ * las tiras de paginas no se buscan entre los slabs, y un objeto de slab
+ * debe ser de la clase de size
+ * @paddr puntero devuelto por allocate_bytes()
+ * @size tamaño pedido a allocate_bytes()
+ * @return 0 en ejecucion correcta, cogigo de error e.o.c
+ */
+int release_bytes_sized(seL4_Word paddr, seL4_Word size) {
+
+	int s, error;
+	seL4_Word pageMask = ((seL4_Word) 1 << seL4_PageBits) - 1;
+
+	if (size > SLAB_MAX_SIZE) {
+		size = (size + pageMask) & ~pageMask;
+		error = release_region_sized(&maxMemoryRegionAllocates, paddr, ROOT_CLIENT, size);
+		if (error == 0) {
+			account_uncharge(ROOT_CLIENT, size, FALSE);
+			pressure_credit(size);
+		}
+		return error;
+	}
+	s = slab_find(paddr);
+	if (s < 0 || slabCache.slabs[s].sizeClass != slab_class(size)) {
+		printf("ERROR: El puntero 0x%08x no es un objeto de %d bytes\n", (unsigned int) paddr, (int) size);
+		return 1;
+	}
+	return slab_free(s, paddr);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  FUNCIONES DE CAPACIDADES (RETYPE, MAPEO Y CNODE)
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Marca como libres (free = TRUE) u ocupados count slots desde first
+ * @first primer slot
+ * @count numero de slots
+ * @free TRUE para liberar, FALSE para ocupar
+ */
+void slots_mark(seL4_CPtr first, int count, seL4_Bool free) {
+
+	seL4_Word i, bits, w, old;
+	seL4_CPtr slot = first, end = first + count;
+
+	while (slot < end) {
+		w = slot / seL4_WordBits;
+		i = slot % seL4_WordBits;
+		// bits del tramo [slot, end) que caen en la palabra w
+		if (end - slot >= seL4_WordBits - i)
+			bits = ~(seL4_Word) 0 << i;
+		else
+			bits = (((seL4_Word) 1 << (end - slot)) - 1) << i;
+		old = slotBitmap.words[w];
+		if (free)
+			slotBitmap.words[w] |= bits;
+		else
+			slotBitmap.words[w] &= ~bits;
+		slotBitmap.countFree += __builtin_popcountl(slotBitmap.words[w]) - __builtin_popcountl(old);
+		if (slotBitmap.words[w])
+			slotBitmap.summary[w / seL4_WordBits] |= (seL4_Word) 1 << (w % seL4_WordBits);
+		else
+			slotBitmap.summary[w / seL4_WordBits] &= ~((seL4_Word) 1 << (w % seL4_WordBits));
+		slot += seL4_WordBits - i;
+	}
+	if (free && first / seL4_WordBits / seL4_WordBits < slotBitmap.hint)
+		slotBitmap.hint = first / seL4_WordBits / seL4_WordBits;
+}
+
+/**
+ * Inicializa el mapa de slots con los slots vacios de boot_info->empty. El
+ * CSpace empieza con un solo nivel, el CNode raiz de boot_info
+ */
+void init_slots(void) {
+
+	int i;
+	seL4_CPtr end = boot_info->empty.end;
+
+	for (i = 0; i < SLOT_WORDS; i++)
+		slotBitmap.words[i] = 0;
+	for (i = 0; i < SLOT_SUMMARY_WORDS; i++)
+		slotBitmap.summary[i] = 0;
+	slotBitmap.countFree = 0;
+	slotBitmap.hint = 0;
+	slotBitmap.growing = FALSE;
+	cspace.root = seL4_CapInitThreadCNode;
+	cspace.countNodes = 0;
+	if (end > CNODE_SLOTS)
+		end = CNODE_SLOTS;
+	if (end > boot_info->empty.start)
+		slots_mark(boot_info->empty.start, end - boot_info->empty.start, TRUE);
+}
+
+int cspace_grow(void);	// seccion CSPACE, necesita el arbol de untyped
+
+/**
+ * Llama a cspace_grow() si no se esta ya dentro de el
+ * @return 0 si el CSpace ha crecido, !0 e.o.c
+ */
+int slots_grow(void) {
+
+	int error;
+
+	if (slotBitmap.growing)
+		return 1;
+	slotBitmap.growing = TRUE;
+	error = cspace_grow();
+	slotBitmap.growing = FALSE;
+	return error;
+}
+
+/**
+ * Hace crecer el CSpace si una reserva de count slots dejaria menos de
+ * CSPACE_GROW_RESERVE libres, que son los que necesita cspace_grow()
+ * @count numero de slots que se van a reservar
+ */
+void slots_ensure(int count) {
+
+	if (slotBitmap.countFree < (seL4_Word) count + CSPACE_GROW_RESERVE)
+		slots_grow();
+}
+
+/**
+ * Reserva un slot libre del CSpace: la primera palabra con algun bit libre
+ * sale del resumen y el bit de la propia palabra, ambos con ctz. hint
+ * apunta a la primera palabra del resumen que puede tener bits a 1
+ * @return slot libre, seL4_CapNull si no quedan
+ */
+seL4_CPtr get_free_slot(void) {
+
+	seL4_Word i, w;
+	seL4_CPtr slot;
+
+	slots_ensure(1);
+	for (i = slotBitmap.hint; i < SLOT_SUMMARY_WORDS && slotBitmap.summary[i] == 0; i++)
+		;
+	slotBitmap.hint = i;
+	if (i == SLOT_SUMMARY_WORDS) {
+		printf("ERROR: No quedan slots libres en el CSpace\n");
+		return seL4_CapNull;
+	}
+	w = i * seL4_WordBits + __builtin_ctzl(slotBitmap.summary[i]);
+	slot = w * seL4_WordBits + __builtin_ctzl(slotBitmap.words[w]);
+	slots_mark(slot, 1, FALSE);
+	return slot;
+}
+
+/**
+ * Busca count slots libres consecutivos dentro de un mismo CNode. Recorre
+ * solo las palabras con algun bit libre y avanza por tramos enteros de
+ * bits iguales con ctz
+ * @count numero de slots
+ * @return primer slot del rango, seL4_CapNull si no hay hueco
+ */
+seL4_CPtr slots_find_range(int count) {
+
+	seL4_Word i, s, w, bits, pos, len, prev = 0;
+	seL4_CPtr start = 0;
+	seL4_Word run = 0;
+
+	for (i = slotBitmap.hint; i < SLOT_SUMMARY_WORDS; i++) {
+		s = slotBitmap.summary[i];
+		while (s) {
+			w = i * seL4_WordBits + __builtin_ctzl(s);
+			s &= s - 1;
+			// una palabra sin bits libres en medio o el inicio de otro CNode cortan el tramo
+			if (run > 0 && (w != prev + 1 || (w * seL4_WordBits) % CNODE_SLOTS == 0))
+				run = 0;
+			prev = w;
+			bits = slotBitmap.words[w];
+			pos = 0;
+			while (pos < seL4_WordBits) {
+				if ((bits >> pos) & 1) {
+					// tramo de slots libres
+					len = (~bits >> pos) ? (seL4_Word) __builtin_ctzl(~bits >> pos) : seL4_WordBits - pos;
+					if (run == 0)
+						start = w * seL4_WordBits + pos;
+					run += len;
+					if (run >= count)
+						return start;
+				} else {
+					// tramo de slots ocupados
+					len = (bits >> pos) ? (seL4_Word) __builtin_ctzl(bits >> pos) : seL4_WordBits - pos;
+					run = 0;
+				}
+				pos += len;
+			}
+		}
+	}
+	return seL4_CapNull;
+}
+
+/**
+ * Reserva count slots libres consecutivos del CSpace, como necesita el
+ * rango destSlots de seL4_Untyped_Retype(), que debe caer en un solo
+ * CNode. Si no hay hueco, hace crecer el CSpace y lo vuelve a intentar
+ * @count numero de slots (como mucho CNODE_SLOTS)
+ * @return primer slot del rango, seL4_CapNull si no hay hueco
+ */
+seL4_CPtr get_free_slots(int count) {
+
+	seL4_CPtr start;
+
+	if (count == 1)
+		return get_free_slot();
+	slots_ensure(count);
+	start = slots_find_range(count);
+	if (start == seL4_CapNull && slots_grow() == 0)
+		start = slots_find_range(count);
+	if (start == seL4_CapNull) {
+		printf("ERROR: No quedan %d slots consecutivos libres en el CSpace\n", count);
+		return seL4_CapNull;
+	}
+	slots_mark(start, count, FALSE);
+	return start;
+}
+
+/**
+ * Devuelve count slots consecutivos al mapa de slots
+ * @first primer slot
+ * @count numero de slots
+ */
+void free_slots(seL4_CPtr first, int count) {
+
+	slots_mark(first, count, TRUE);
+}
+
+/**
+ * Devuelve de una vez una lista de slots sueltos al mapa de slots
+ * @slots[] slots a devolver
+ * @count numero de slots
+ */
+void free_slot_list(seL4_CPtr *slots, int count) {
+
+	int i;
+
+	for (i = 0; i < count; i++)
+		slots_mark(slots[i], 1, TRUE);
+}
+
+/**
+ * Borra la capacidad de un slot y lo devuelve al mapa de slots. Sirve para
+ * las capacidades que solo se crean para transferirlas a un cliente
+ * @slot slot a vaciar
+ */
+void cap_discard(seL4_CPtr slot) {
+
+	seL4_CNode_Delete(cspace.root, slot, seL4_WordBits);
+	free_slots(slot, 1);
+}
+
+/**
+ * Calcula el destino de seL4_Untyped_Retype() para un rango de slots que
+ * empieza en slot. Con un solo nivel el destino es el propio CNode raiz;
+ * con dos, el CNode de nivel 2 que contiene slot
+ * @slot primer slot del rango (el rango no cruza de CNode)
+ * @index donde se devuelve nodeIndex
+ * @depth donde se devuelve nodeDepth
+ * @return nodeOffset del primer slot dentro de su CNode
+ */
+seL4_Word slot_dest(seL4_CPtr slot, seL4_Word *index, seL4_Word *depth) {
+
+	if (cspace.countNodes == 0) {
+		*index = 0;
+		*depth = 0;
+		return slot;
+	}
+	*index = slot / CNODE_SLOTS;
+	*depth = seL4_WordBits - CONFIG_ROOT_CNODE_SIZE_BITS;
+	return slot % CNODE_SLOTS;
+}
+
+/**
+ * Crea con un solo untyped todos los objetos descritos en descs[],
+ * rellenando slots consecutivos del CNode raiz a partir de destSlot.
+ * Cada descriptor se resuelve con el menor numero de llamadas posible
+ * (hasta CONFIG_RETYPE_FAN_OUT_LIMIT objetos por llamada). Para no perder
+ * memoria por alineamiento conviene ordenar descs[] de mayor a menor tamaño
+ * @untyped capacidad untyped de la que se crean los objetos
+ * @descs[] lista de descriptores (tipo, tamaño, cantidad)
+ * @countDescs numero de descriptores de descs[]
+ * @destSlot primer slot libre del rango destino en el CNode raiz
+ * @return 0 en ejecucion correcta, codigo de error seL4 e.o.c
+ */
+int retype_batch(seL4_CPtr untyped, struct ObjectDesc *descs, int countDescs, seL4_CPtr destSlot) {
+
+	int i, count, num;
+	seL4_Word index, depth, offset;
+	seL4_Error error;
+
+	for (i = 0; i < countDescs; i++) {
+		count = descs[i].count;
+		while (count > 0) {
+			num = count < CONFIG_RETYPE_FAN_OUT_LIMIT ? count : CONFIG_RETYPE_FAN_OUT_LIMIT;
+			offset = slot_dest(destSlot, &index, &depth);
+			error = seL4_Untyped_Retype(untyped, descs[i].type, descs[i].sizeBits, cspace.root, index, depth, offset, num);
+			if (error != seL4_NoError) {
+				printf("ERROR: retype_batch() tipo %d, %d objetos en slot 0x%08x (error %d)\n", (int) descs[i].type, num, (unsigned int) destSlot, error);
+				return error;
+			}
+			destSlot += num;
+			count -= num;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Mapea un rango de frames en slots consecutivos (firstFrame..firstFrame+count-1)
+ * en paginas virtuales consecutivas de vspace a partir de vaddr. Se detiene en
+ * el primer error sin deshacer lo mapeado, de modo que el llamador pueda crear
+ * la estructura de paginacion que falte (seL4_FailedLookup) y continuar
+ * llamando de nuevo con firstFrame + mapeados y vaddr + (mapeados << pageBits)
+ * @firstFrame slot del primer frame a mapear
+ * @count numero de frames a mapear
+ * @vspace capacidad del VSpace destino
+ * @vaddr direccion virtual del primer frame, alineada a 2^pageBits
+ * @pageBits tamaño de cada frame (seL4_PageBits o seL4_LargePageBits)
+ * @rights derechos de acceso del mapeo
+ * @error si no es NULL, error seL4 que detuvo el mapeo (seL4_NoError si no hubo)
+ * @return numero de frames mapeados
+ */
+int map_frames(seL4_CPtr firstFrame, int count, seL4_CPtr vspace, seL4_Word vaddr, seL4_Uint8 pageBits, seL4_CapRights_t rights, seL4_Error *error) {
+
+	int i;
+	seL4_Error err = seL4_NoError;
+
+	for (i = 0; i < count; i++) {
+		err = seL4_X86_Page_Map(firstFrame + i, vspace, vaddr + ((seL4_Word) i << pageBits), rights, seL4_X86_Default_VMAttributes);
+		if (err != seL4_NoError)
+			break;
+	}
+	if (error != NULL)
+		*error = err;
+	return i;
+}
+
+/**
+ * Ejecuta en orden una lista de operaciones copy/mint/move/delete sobre el
+ * CNode raiz. Se detiene en la primera que falle sin deshacer las anteriores
+ * @ops[] lista de operaciones
+ * @countOps numero de operaciones de ops[]
+ * @error si no es NULL, error seL4 que detuvo la lista (seL4_NoError si no hubo)
+ * @return numero de operaciones completadas
+ */
+int cnode_batch(struct CNodeOp *ops, int countOps, seL4_Error *error) {
+
+	int i;
+	seL4_Error err = seL4_NoError;
+
+	for (i = 0; i < countOps; i++) {
+		switch (ops[i].op) {
+		case CNODE_OP_COPY:
+			err = seL4_CNode_Copy(cspace.root, ops[i].dest, seL4_WordBits, cspace.root, ops[i].src, seL4_WordBits, ops[i].rights);
+			break;
+		case CNODE_OP_MINT:
+			err = seL4_CNode_Mint(cspace.root, ops[i].dest, seL4_WordBits, cspace.root, ops[i].src, seL4_WordBits, ops[i].rights, ops[i].badge);
+			break;
+		case CNODE_OP_MOVE:
+			err = seL4_CNode_Move(cspace.root, ops[i].dest, seL4_WordBits, cspace.root, ops[i].src, seL4_WordBits);
+			break;
+		case CNODE_OP_DELETE:
+			err = seL4_CNode_Delete(cspace.root, ops[i].dest, seL4_WordBits);
+			break;
+		default:
+			err = seL4_InvalidArgument;
+		}
+		if (err != seL4_NoError)
+			break;
+	}
+	if (error != NULL)
+		*error = err;
+	return i;
+}
+
+/**
+ * Indica si un rango de memoria se solapa con la region gestionada por allocate()
+ * @paddr inicio del rango
+ * @size tamaño del rango
+ * @return TRUE si se solapan, FALSE e.o.c
+ */
+seL4_Bool in_managed_region(seL4_Word paddr, seL4_Word size) {
+
+	seL4_Word start, end;
+
+	start = maxMemoryRegionAllocates.regions[0].paddr;
+	end = maxMemoryRegionAllocates.regions[maxMemoryRegionAllocates.countRegions-1].paddr + maxMemoryRegionAllocates.regions[maxMemoryRegionAllocates.countRegions-1].sizeBitsPow;
+	return paddr < end && paddr + size > start;
+}
+
+/**
+ * Tamaño en memoria de un objeto del kernel
+ * @type tipo de objeto a crear
+ * @sizeBits tamaño pasado a seL4_Untyped_Retype() (untyped y CNode)
+ * @return log2 del tamaño del objeto, 0 si el tipo no se conoce
+ */
+seL4_Uint8 object_size_bits(seL4_Word type, seL4_Uint8 sizeBits) {
+
+	switch (type) {
+	case seL4_UntypedObject:
+		return sizeBits;
+	case seL4_TCBObject:
+		return seL4_TCBBits;
+	case seL4_EndpointObject:
+		return seL4_EndpointBits;
+	case seL4_NotificationObject:
+		return seL4_NotificationBits;
+	case seL4_CapTableObject:
+		return sizeBits + seL4_SlotBits;
+	case seL4_X86_4K:
+		return seL4_PageBits;
+	case seL4_X86_LargePageObject:
+		return seL4_LargePageBits;
+	case seL4_X64_HugePageObject:
+		return seL4_HugePageBits;
+	case seL4_X86_PageTableObject:
+		return seL4_PageTableBits;
+	case seL4_X86_PageDirectoryObject:
+		return seL4_PageDirBits;
+	case seL4_X86_PDPTObject:
+		return seL4_PDPTBits;
+	case seL4_X64_PML4Object:
+		return seL4_PML4Bits;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Elige el untyped de objetos donde crear uno de 2^objBits: el que pierde
+ * menos bytes al alinear su watermark y, a igualdad, el que tiene menos
+ * espacio libre (best fit), para no partir los untyped grandes
+ * @objBits log2 del tamaño del objeto
+ * @return indice en objectUntypeds.untypeds[], -1 si no cabe en ninguno
+ */
+int object_untyped_best(seL4_Uint8 objBits) {
+
+	int i, best = -1;
+	seL4_Word mask = ((seL4_Word) 1 << objBits) - 1;
+	seL4_Word next, padding, left, bestPadding = 0, bestLeft = 0;
+	struct ObjectUntyped *u;
+
+	for (i = 0; i < objectUntypeds.countUntypeds; i++) {
+		u = &objectUntypeds.untypeds[i];
+		next = ((u->paddr + u->watermark + mask) & ~mask) - u->paddr;
+		if (next + mask + 1 > ((seL4_Word) 1 << u->sizeBits))
+			continue;
+		padding = next - u->watermark;
+		left = ((seL4_Word) 1 << u->sizeBits) - next - mask - 1;
+		if (best < 0 || padding < bestPadding || (padding == bestPadding && left < bestLeft)) {
+			best = i;
+			bestPadding = padding;
+			bestLeft = left;
+		}
+	}
+	return best;
+}
+
+/**
+ * Crea un objeto del kernel para uso propio de Root_task a partir de los
+ * untyped que quedan fuera de la region gestionada por allocate(), de modo
+ * que no interfiera con las direcciones que reparte el asignador. Usa el
+ * untyped que elige object_untyped_best() y actualiza su watermark
+ * @type tipo de objeto seL4
+ * @sizeBits tamaño de usuario del objeto (solo CNodes y untyped), 0 e.o.c
+ * @return slot con la capacidad del objeto creado, seL4_CapNull e.o.c
+ */
+seL4_CPtr create_object(seL4_Word type, seL4_Uint8 sizeBits) {
+
+	int i;
+	seL4_CPtr slot;
+	seL4_Uint8 objBits = object_size_bits(type, sizeBits);
+	seL4_Word mask = ((seL4_Word) 1 << objBits) - 1;
+	seL4_Word index, depth, offset;
+	struct ObjectUntyped *u;
+
+	i = object_untyped_best(objBits);
+	if (i < 0) {
+		printf("ERROR: No hay untyped libre para crear un objeto de tipo %d\n", (int) type);
+		return seL4_CapNull;
+	}
+	slot = get_free_slot();
+	if (slot == seL4_CapNull)
+		return seL4_CapNull;
+	u = &objectUntypeds.untypeds[i];
+	offset = slot_dest(slot, &index, &depth);
+	if (seL4_Untyped_Retype(u->cap, type, sizeBits, cspace.root, index, depth, offset, 1) != seL4_NoError) {
+		printf("ERROR: No se ha podido crear un objeto de tipo %d\n", (int) type);
+		free_slots(slot, 1);
+		return seL4_CapNull;
+	}
+	// el kernel alinea el objeto a su tamaño a partir del watermark
+	u->padding += (((u->paddr + u->watermark + mask) & ~mask) - u->paddr) - u->watermark;
+	u->watermark = (((u->paddr + u->watermark + mask) & ~mask) - u->paddr) + mask + 1;
+	u->countChildren++;
+	return slot;
+}
+
+/**
+ * Crea y mapea en un VSpace la estructura de paginacion de un nivel que
+ * cubre vaddr, creando antes las de niveles superiores que falten
+ * @vspace capacidad del VSpace (seL4_CapInitThreadVSpace para Root_task)
+ * @level 0 page table, 1 page directory, 2 PDPT
+ * @vaddr direccion virtual a cubrir
+ * @return seL4_NoError en ejecucion correcta, error seL4 e.o.c
+ */
+seL4_Error map_paging_structure(seL4_CPtr vspace, int level, seL4_Word vaddr) {
+
+	static const seL4_Word types[] = {seL4_X86_PageTableObject, seL4_X86_PageDirectoryObject, seL4_X86_PDPTObject};
+	seL4_CPtr table;
+	seL4_Error error;
+	int retry = TRUE;
+
+	table = create_object(types[level], 0);
+	if (table == seL4_CapNull)
+		return seL4_NotEnoughMemory;
+	do {
+		if (level == 0)
+			error = seL4_X86_PageTable_Map(table, vspace, vaddr, seL4_X86_Default_VMAttributes);
+		else if (level == 1)
+			error = seL4_X86_PageDirectory_Map(table, vspace, vaddr, seL4_X86_Default_VMAttributes);
+		else
+			error = seL4_X86_PDPT_Map(table, vspace, vaddr, seL4_X86_Default_VMAttributes);
+		// falta el nivel superior: crearlo y reintentar una vez
+		if (error == seL4_FailedLookup && level < 2 && retry) {
+			error = map_paging_structure(vspace, level + 1, vaddr);
+			retry = FALSE;
+		} else {
+			break;
+		}
+	} while (error == seL4_NoError);
+	return error;
+}
+
+/**
+ * Mapea un frame de 4 KiB en el VSpace de Root_task, creando las
+ * estructuras de paginacion que falten
+ * @frame capacidad del frame
+ * @vaddr direccion virtual, alineada a pagina
+ * @return seL4_NoError en ejecucion correcta, error seL4 e.o.c
+ */
+seL4_Error map_page(seL4_CPtr frame, seL4_Word vaddr) {
+
+	seL4_Error error;
+
+	map_frames(frame, 1, seL4_CapInitThreadVSpace, vaddr, seL4_PageBits, seL4_AllRights, &error);
+	if (error == seL4_FailedLookup) {
+		error = map_paging_structure(seL4_CapInitThreadVSpace, 0, vaddr);
+		if (error == seL4_NoError)
+			map_frames(frame, 1, seL4_CapInitThreadVSpace, vaddr, seL4_PageBits, seL4_AllRights, &error);
+	}
+	return error;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  UNTYPED DERIVADOS Y SUB-ARENAS
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Crea las raices del arbol de untyped: los untyped de boot_info que forman
+ * la region gestionada por allocate()
+ */
+void init_untyped_tree(void) {
+
+	int i;
+	struct UntypedNode *node;
+	struct ObjectUntyped *object;
+
+	untypedTree.countNodes = 0;
+	untypedTree.countFreePairs = 0;
+	objectUntypeds.countUntypeds = 0;
+	for (i = 0; i < boot_info->untyped.end - boot_info->untyped.start; i++) {
+		if (boot_info->untypedList[i].isDevice)
+			continue;
+		if (!in_managed_region(boot_info->untypedList[i].paddr, (seL4_Word) 1 << boot_info->untypedList[i].sizeBits)) {
+			// fuera de la region gestionada: untyped para create_object()
+			object = &objectUntypeds.untypeds[objectUntypeds.countUntypeds++];
+			object->cap = boot_info->untyped.start + i;
+			object->paddr = boot_info->untypedList[i].paddr;
+			object->sizeBits = boot_info->untypedList[i].sizeBits;
+			object->watermark = 0;
+			object->padding = 0;
+			object->countChildren = 0;
+			continue;
+		}
+		node = &untypedTree.nodes[untypedTree.countNodes++];
+		node->cap = boot_info->untyped.start + i;
+		node->paddr = boot_info->untypedList[i].paddr;
+		node->sizeBits = boot_info->untypedList[i].sizeBits;
+		node->parent = -1;
+		node->child = -1;
+		node->inUse = FALSE;
+		node->watermark = 0;
+	}
+	untypedTree.countRoots = untypedTree.countNodes;
+}
+
+/**
+ * Divide un nodo libre en sus dos mitades con un solo retype
+ * @n indice del nodo a dividir
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int untyped_split(int n) {
+
+	int c, k;
+	seL4_CPtr slot;
+	seL4_Word index, depth, offset;
+	seL4_Error error;
+
+	if (untypedTree.countFreePairs > 0) {
+		c = untypedTree.freePairs[--untypedTree.countFreePairs];
+	} else if (untypedTree.countNodes + 2 <= MAX_UNTYPED_NODES) {
+		c = untypedTree.countNodes;
+		untypedTree.countNodes += 2;
+	} else {
+		printf("ERROR: No caben mas nodos en el arbol de untyped\n");
+		return 1;
+	}
+	slot = get_free_slots(2);
+	if (slot == seL4_CapNull) {
+		untypedTree.freePairs[untypedTree.countFreePairs++] = c;
+		return 2;
+	}
+	offset = slot_dest(slot, &index, &depth);
+	error = seL4_Untyped_Retype(untypedTree.nodes[n].cap, seL4_UntypedObject, untypedTree.nodes[n].sizeBits - 1, cspace.root, index, depth, offset, 2);
+	if (error != seL4_NoError) {
+		printf("ERROR: No se ha podido dividir el untyped 0x%08x (error %d)\n", (unsigned int) untypedTree.nodes[n].paddr, error);
+		free_slots(slot, 2);
+		untypedTree.freePairs[untypedTree.countFreePairs++] = c;
+		return error;
+	}
+	for (k = 0; k < 2; k++) {
+		untypedTree.nodes[c+k].cap = slot + k;
+		untypedTree.nodes[c+k].paddr = untypedTree.nodes[n].paddr + ((seL4_Word) k << (untypedTree.nodes[n].sizeBits - 1));
+		untypedTree.nodes[c+k].sizeBits = untypedTree.nodes[n].sizeBits - 1;
+		untypedTree.nodes[c+k].parent = n;
+		untypedTree.nodes[c+k].child = -1;
+		untypedTree.nodes[c+k].inUse = FALSE;
+		untypedTree.nodes[c+k].watermark = 0;
+	}
+	untypedTree.nodes[n].child = c;
+	untypedTree.nodes[n].watermark = (seL4_Word) 1 << untypedTree.nodes[n].sizeBits;
+	return 0;
+}
+
+/**
+ * Obtiene un untyped que cubra exactamente [paddr, paddr + 2^sizeBits),
+ * dividiendo los nodos necesarios, y lo marca como usado
+ * @paddr inicio de la region, alineada a 2^sizeBits
+ * @sizeBits tamaño de la region
+ * @return indice del nodo en untypedTree.nodes[], -1 e.o.c
+ */
+int untyped_get(seL4_Word paddr, seL4_Uint8 sizeBits) {
+
+	int n;
+	seL4_Word size = (seL4_Word) 1 << sizeBits;
+
+	if (paddr & (size - 1))
+		return -1;
+	// raiz que contiene la region entera
+	for (n = 0; n < untypedTree.countRoots; n++) {
+		if (paddr >= untypedTree.nodes[n].paddr && paddr + size <= untypedTree.nodes[n].paddr + ((seL4_Word) 1 << untypedTree.nodes[n].sizeBits))
+			break;
+	}
+	if (n == untypedTree.countRoots)
+		return -1;
+	// bajar por la mitad que contiene paddr hasta llegar al tamaño pedido
+	while (untypedTree.nodes[n].sizeBits > sizeBits) {
+		if (untypedTree.nodes[n].inUse)
+			return -1;
+		if (untypedTree.nodes[n].child < 0 && untyped_split(n) != 0)
+			return -1;
+		if (paddr >= untypedTree.nodes[n].paddr + ((seL4_Word) 1 << (untypedTree.nodes[n].sizeBits - 1)))
+			n = untypedTree.nodes[n].child + 1;
+		else
+			n = untypedTree.nodes[n].child;
+	}
+	if (untypedTree.nodes[n].inUse || untypedTree.nodes[n].child >= 0)
+		return -1;
+	untypedTree.nodes[n].inUse = TRUE;
+	return n;
+}
+
+/**
+ * Devuelve un untyped obtenido con untyped_get(). Revoca todo lo derivado de
+ * el (copias entregadas y objetos creados) y junta las mitades libres
+ * @n indice del nodo a devolver
+ */
+void untyped_put(int n) {
+
+	int p, c;
+
+	seL4_CNode_Revoke(cspace.root, untypedTree.nodes[n].cap, seL4_WordBits);
+	untypedTree.nodes[n].inUse = FALSE;
+	p = untypedTree.nodes[n].parent;
+	while (p >= 0) {
+		c = untypedTree.nodes[p].child;
+		if (untypedTree.nodes[c].inUse || untypedTree.nodes[c].child >= 0 || untypedTree.nodes[c+1].inUse || untypedTree.nodes[c+1].child >= 0)
+			break;
+		// las dos mitades estan libres: revocar el padre las borra y lo deja entero
+		if (seL4_CNode_Revoke(cspace.root, untypedTree.nodes[p].cap, seL4_WordBits) != seL4_NoError)
+			break;
+		free_slots(untypedTree.nodes[c].cap, 2);
+		untypedTree.nodes[p].child = -1;
+		untypedTree.nodes[p].watermark = 0;
+		untypedTree.freePairs[untypedTree.countFreePairs++] = c;
+		p = untypedTree.nodes[p].parent;
+	}
+}
+
+/**
+ * Busca el nodo hoja libre del arbol desde el que se llega a un untyped de
+ * 2^sizeBits con menos divisiones (retypes), y cuya memoria este libre
+ * tambien en la lista de regiones. A igualdad, el de menor paddr
+ * @sizeBits tamaño buscado
+ * @return indice del nodo, -1 si no hay ninguno
+ */
+int untyped_find_best(seL4_Uint8 sizeBits) {
+
+	int n, p, best = -1;
+	struct UntypedNode *node;
+
+	for (n = 0; n < untypedTree.countNodes; n++) {
+		node = &untypedTree.nodes[n];
+		p = node->parent;
+		// saltar los nodos de parejas ya liberadas (su padre ya no los apunta)
+		if (p >= 0 && untypedTree.nodes[p].child != n && untypedTree.nodes[p].child + 1 != n)
+			continue;
+		if (node->inUse || node->child >= 0 || node->watermark != 0 || node->sizeBits < sizeBits)
+			continue;
+		if (best >= 0 && node->sizeBits >= untypedTree.nodes[best].sizeBits)
+			continue;
+		if (find_free_region(&maxMemoryRegionAllocates, node->paddr, (seL4_Word) 1 << node->sizeBits) < 0)
+			continue;
+		best = n;
+		if (node->sizeBits == sizeBits)
+			break;
+	}
+	return best;
+}
+
+/**
+ * Reserva una region de 2^sizeBits que pueda tener su propio untyped. Usa
+ * el principio del nodo que devuelve untyped_find_best(), de modo que
+ * untyped_get() haga las minimas divisiones; si no hay, allocate_aligned()
+ * @sizeBits tamaño de memoria a reservar
+ * @owner propietario de la region
+ * @return puntero a la region de memoria reservada, 0 e.o.c con msg de error
+ */
+seL4_Word allocate_untyped(seL4_Uint8 sizeBits, seL4_Word owner) {
+
+	int n = untyped_find_best(sizeBits);
+
+	if (n >= 0 && reserve_region(&maxMemoryRegionAllocates, untypedTree.nodes[n].paddr, (seL4_Word) 1 << sizeBits, owner) == 0) {
+		pressure_charge((seL4_Word) 1 << sizeBits);
+		return untypedTree.nodes[n].paddr;
+	}
+	return allocate_aligned(sizeBits, owner);
+}
+
+/**
+ * Reserva para Root_task una region de 2^sizeBits con su propio untyped
+ * @sizeBits tamaño del untyped
+ * @return indice del nodo de untypedTree, -1 e.o.c
+ */
+int untyped_reserve(seL4_Uint8 sizeBits) {
+
+	int node;
+	seL4_Word paddr;
+
+	paddr = allocate_untyped(sizeBits, ROOT_CLIENT | OWNER_UNTYPED);
+	if (paddr == 0)
+		return -1;
+	node = untyped_get(paddr, sizeBits);
+	if (node < 0) {
+		release_region(&maxMemoryRegionAllocates, paddr, ROOT_CLIENT | OWNER_UNTYPED, NULL);
+		pressure_credit((seL4_Word) 1 << sizeBits);
+	}
+	return node;
+}
+
+/**
+ * Devuelve una region reservada con untyped_reserve(), revocando todo lo
+ * creado a partir de su untyped
+ * @node indice del nodo de untypedTree
+ */
+void untyped_unreserve(int node) {
+
+	seL4_Word paddr = untypedTree.nodes[node].paddr;
+	seL4_Uint8 sizeBits = untypedTree.nodes[node].sizeBits;
+
+	untyped_put(node);
+	release_region(&maxMemoryRegionAllocates, paddr, ROOT_CLIENT | OWNER_UNTYPED, NULL);
+	pressure_credit((seL4_Word) 1 << sizeBits);
+}
+
+/**
+ * Indica si ningun nodo del subarbol de n esta entregado
+ * @n indice del nodo en untypedTree
+ * @return TRUE si todo el subarbol esta libre, FALSE e.o.c
+ */
+seL4_Bool untyped_subtree_free(int n) {
+
+	int c = untypedTree.nodes[n].child;
+
+	if (untypedTree.nodes[n].inUse)
+		return FALSE;
+	return c < 0 || (untyped_subtree_free(c) && untyped_subtree_free(c+1));
+}
+
+/**
+ * Deshace las divisiones del subarbol de n (ya revocado) y devuelve sus
+ * pares de nodos a freePairs
+ * @n indice del nodo en untypedTree
+ */
+void untyped_collapse(int n) {
+
+	int c = untypedTree.nodes[n].child;
+
+	if (c < 0)
+		return;
+	untyped_collapse(c);
+	untyped_collapse(c+1);
+	free_slots(untypedTree.nodes[c].cap, 2);
+	untypedTree.freePairs[untypedTree.countFreePairs++] = c;
+	untypedTree.nodes[n].child = -1;
+	untypedTree.nodes[n].watermark = 0;
+}
+
+/**
+ * Devuelve de una vez varios nodos entregados. Para cada uno sube hasta el
+ * antecesor mas alto que queda libre entero y revoca solo ese: un
+ * seL4_CNode_Revoke por untyped padre, no uno por nodo
+ * @nodes[] indices de los nodos a devolver
+ * @countNodes numero de nodos
+ */
+void untyped_put_batch(int *nodes, int countNodes) {
+
+	int tops[MAX_SUB_ARENAS];
+	int countTops = 0, i, j, n, p;
+
+	for (i = 0; i < countNodes; i++)
+		untypedTree.nodes[nodes[i]].inUse = FALSE;
+	// primero se calculan los antecesores a revocar, antes de modificar el arbol
+	for (i = 0; i < countNodes; i++) {
+		n = nodes[i];
+		p = untypedTree.nodes[n].parent;
+		while (p >= 0 && untyped_subtree_free(p)) {
+			n = p;
+			p = untypedTree.nodes[n].parent;
+		}
+		j = 0;
+		while (j < countTops && tops[j] != n)
+			j++;
+		if (j == countTops)
+			tops[countTops++] = n;
+	}
+	for (i = 0; i < countTops; i++) {
+		if (seL4_CNode_Revoke(cspace.root, untypedTree.nodes[tops[i]].cap, seL4_WordBits) == seL4_NoError)
+			untyped_collapse(tops[i]);
+	}
+}
+
+/**
+ * Crea un sub-arena de 2^sizeBits para un cliente: reserva una region
+ * alineada y obtiene su untyped, que se entrega al cliente para que haga
+ * sus propias reservas sin pasar por el servidor
+ * @client identificador del cliente
+ * @sizeBits tamaño del sub-arena
+ * @paddr donde se devuelve el inicio del sub-arena
+ * @return capacidad del untyped a transferir al cliente, seL4_CapNull e.o.c
+ */
+seL4_CPtr subarena_create(seL4_Word client, seL4_Uint8 sizeBits, seL4_Word *paddr) {
+
+	int node;
+
+	*paddr = 0;
+	if (subArenas.countArenas == MAX_SUB_ARENAS) {
+		printf("ERROR: No se pueden delegar mas de %d sub-arenas\n", MAX_SUB_ARENAS);
+		return seL4_CapNull;
+	}
+	if (account_charge(client, (seL4_Word) 1 << sizeBits, TRUE) < 0) {
+		printf("ERROR: El sub-arena supera el limite del cliente %d\n", (int) client);
+		return seL4_CapNull;
+	}
+	// con OWNER_UNTYPED el cliente no puede liberarla con MEMSRV_RELEASE mientras el untyped siga delegado
+	*paddr = allocate_untyped(sizeBits, client | OWNER_UNTYPED);
+	if (*paddr == 0) {
+		account_uncharge(client, (seL4_Word) 1 << sizeBits, TRUE);
+		return seL4_CapNull;
+	}
+	node = untyped_get(*paddr, sizeBits);
+	if (node < 0) {
+		printf("ERROR: No hay un untyped para el sub-arena 0x%08x\n", (unsigned int) *paddr);
+		release_region(&maxMemoryRegionAllocates, *paddr, client | OWNER_UNTYPED, NULL);
+		pressure_credit((seL4_Word) 1 << sizeBits);
+		account_uncharge(client, (seL4_Word) 1 << sizeBits, TRUE);
+		*paddr = 0;
+		return seL4_CapNull;
+	}
+	subArenas.arenas[subArenas.countArenas].client = client;
+	subArenas.arenas[subArenas.countArenas].paddr = *paddr;
+	subArenas.arenas[subArenas.countArenas].node = node;
+	subArenas.countArenas++;
+	return untypedTree.nodes[node].cap;
+}
+
+/**
+ * Recupera un sub-arena de un cliente: revoca su untyped (y con ello la
+ * copia del cliente y todo lo que haya creado) y libera la region
+ * @client identificador del cliente
+ * @paddr inicio del sub-arena
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int subarena_release(seL4_Word client, seL4_Word paddr) {
+
+	int i = 0;
+	unsigned int size;
+
+	while (i < subArenas.countArenas && (subArenas.arenas[i].client != client || subArenas.arenas[i].paddr != paddr))
+		i++;
+	if (i == subArenas.countArenas) {
+		printf("ERROR: El cliente %d no tiene un sub-arena en 0x%08x\n", (int) client, (unsigned int) paddr);
+		return 1;
+	}
+	untyped_put(subArenas.arenas[i].node);
+	if (release_region(&maxMemoryRegionAllocates, paddr, client | OWNER_UNTYPED, &size) == 0) {
+		account_uncharge(client, size, TRUE);
+		pressure_credit(size);
+	}
+	subArenas.arenas[i] = subArenas.arenas[--subArenas.countArenas];
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  CSPACE DE DOS NIVELES
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Crea un CNode de 2^radixBits slots con memoria de la region gestionada
+ * @radixBits log2 del numero de slots
+ * @node donde se devuelve el nodo de untypedTree del que sale el CNode
+ * @return slot con la capacidad del CNode, seL4_CapNull e.o.c
+ */
+seL4_CPtr cnode_create(seL4_Uint8 radixBits, int *node) {
+
+	seL4_CPtr slot;
+	seL4_Word index, depth, offset;
+
+	*node = untyped_reserve(radixBits + seL4_SlotBits);
+	if (*node < 0)
+		return seL4_CapNull;
+	slot = get_free_slot();
+	if (slot != seL4_CapNull) {
+		offset = slot_dest(slot, &index, &depth);
+		if (seL4_Untyped_Retype(untypedTree.nodes[*node].cap, seL4_CapTableObject, radixBits, cspace.root, index, depth, offset, 1) == seL4_NoError)
+			return slot;
+		free_slots(slot, 1);
+	}
+	printf("ERROR: No se ha podido crear un CNode de 2^%d slots\n", (int) radixBits);
+	untyped_unreserve(*node);
+	return seL4_CapNull;
+}
+
+/**
+ * Deshace cnode_create(): revocar el untyped borra el CNode y todo lo
+ * derivado de el, y la region vuelve a estar libre
+ * @slot slot con la capacidad del CNode
+ * @node nodo de untypedTree devuelto por cnode_create()
+ */
+void cnode_destroy(seL4_CPtr slot, int node) {
+
+	untyped_unreserve(node);
+	free_slots(slot, 1);
+}
+
+/**
+ * Pasa el CSpace de Root_task a dos niveles: crea el CNode superior, pone
+ * en su slot 0 el CNode raiz de boot_info sin guarda y lo instala en el TCB.
+ * Los cptr existentes siguen siendo validos
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int cspace_make_two_level(void) {
+
+	int node, error = 0;
+	seL4_CPtr top, root;
+	seL4_Word guardBits = seL4_WordBits - CSPACE_TOP_BITS - CONFIG_ROOT_CNODE_SIZE_BITS;
+
+	top = cnode_create(CSPACE_TOP_BITS, &node);
+	if (top == seL4_CapNull)
+		return 1;
+	root = get_free_slot();
+	if (root == seL4_CapNull) {
+		cnode_destroy(top, node);
+		return 1;
+	}
+	// capacidad del CNode superior con guarda 0 para resolver cptr de seL4_WordBits bits
+	if (seL4_CNode_Mint(seL4_CapInitThreadCNode, root, seL4_WordBits, seL4_CapInitThreadCNode, top, seL4_WordBits, seL4_AllRights, seL4_CNode_CapData_new(0, guardBits).words[0]) != seL4_NoError)
+		error = 2;
+	// slot 0: el CNode raiz original sin guarda, cptr 0..CNODE_SLOTS-1
+	else if (seL4_CNode_Mint(root, 0, seL4_WordBits - CONFIG_ROOT_CNODE_SIZE_BITS, seL4_CapInitThreadCNode, seL4_CapInitThreadCNode, seL4_WordBits, seL4_AllRights, seL4_CNode_CapData_new(0, 0).words[0]) != seL4_NoError)
+		error = 3;
+	else if (seL4_TCB_SetSpace(seL4_CapInitThreadTCB, seL4_CapNull, root, 0, seL4_CapInitThreadVSpace, 0) != seL4_NoError)
+		error = 4;
+	if (error) {
+		// el TCB sigue con el CNode raiz: borrar root y el CNode superior (con su slot 0)
+		cap_discard(root);
+		cnode_destroy(top, node);
+		return error;
+	}
+	cspace.root = root;
+	cspace.countNodes = 1;
+	return 0;
+}
+
+/**
+ * Añade al CSpace un CNode de nivel 2 de CNODE_SLOTS slots y deja sus slots
+ * libres en el mapa de slots. La primera vez pasa el CSpace a dos niveles
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int cspace_grow(void) {
+
+	seL4_CPtr cnode;
+	int node, error;
+
+	if (cspace.countNodes == 0) {
+		error = cspace_make_two_level();
+		if (error) {
+			printf("ERROR: No se ha podido pasar el CSpace a dos niveles (paso %d)\n", error);
+			return error;
+		}
+	}
+	if (cspace.countNodes == 1 << CSPACE_TOP_BITS) {
+		printf("ERROR: El CSpace ya tiene %d CNodes\n", 1 << CSPACE_TOP_BITS);
+		return 5;
+	}
+	cnode = cnode_create(CONFIG_ROOT_CNODE_SIZE_BITS, &node);
+	if (cnode == seL4_CapNull)
+		return 6;
+	if (seL4_CNode_Mint(cspace.root, cspace.countNodes, seL4_WordBits - CONFIG_ROOT_CNODE_SIZE_BITS, cspace.root, cnode, seL4_WordBits, seL4_AllRights, seL4_CNode_CapData_new(0, 0).words[0]) != seL4_NoError) {
+		cnode_destroy(cnode, node);
+		return 7;
+	}
+	free_slots((seL4_CPtr) cspace.countNodes * CNODE_SLOTS, CNODE_SLOTS);
+	cspace.countNodes++;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  POOLS DE OBJETOS DEL KERNEL
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Inicializa los pools de TCBs, endpoints y notifications (vacios) y la
+ * lista de trozos de allocate_object()
+ */
+void init_object_pools(void) {
+
+	static const seL4_Word types[POOL_TYPES] = {seL4_TCBObject, seL4_EndpointObject, seL4_NotificationObject};
+	int i;
+
+	for (i = 0; i < POOL_TYPES; i++) {
+		objectPools[i].type = types[i];
+		objectPools[i].countFree = 0;
+		objectPools[i].countCreated = 0;
+		objectPools[i].countUsed = 0;
+	}
+	objectChunks.countChunks = 0;
+}
+
+/**
+ * Busca el pool de un tipo de objeto
+ * @type tipo de objeto seL4
+ * @return pool del tipo, NULL si el tipo no tiene pool
+ */
+struct ObjectPool *pool_of(seL4_Word type) {
+
+	int i;
+
+	for (i = 0; i < POOL_TYPES; i++)
+		if (objectPools[i].type == type)
+			return &objectPools[i];
+	return NULL;
+}
+
+/**
+ * Crea POOL_REFILL objetos de golpe (un solo retype sobre un untyped
+ * reservado para ellos) y los deja libres en el pool
+ * @pool pool a rellenar
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int pool_refill(struct ObjectPool *pool) {
+
+	int node, k;
+	seL4_CPtr slot;
+	struct ObjectDesc desc;
+
+	if (pool->countCreated + POOL_REFILL > POOL_MAX_OBJECTS) {
+		printf("ERROR: El pool de objetos de tipo %d ya tiene %d objetos\n", (int) pool->type, pool->countCreated);
+		return 1;
+	}
+	node = untyped_reserve(object_size_bits(pool->type, 0) + POOL_REFILL_BITS);
+	if (node < 0)
+		return 2;
+	slot = get_free_slots(POOL_REFILL);
+	desc.type = pool->type;
+	desc.sizeBits = 0;
+	desc.count = POOL_REFILL;
+	if (slot == seL4_CapNull || retype_batch(untypedTree.nodes[node].cap, &desc, 1, slot) != 0) {
+		if (slot != seL4_CapNull)
+			free_slots(slot, POOL_REFILL);
+		untyped_unreserve(node);
+		return 3;
+	}
+	// en orden inverso para que pool_get() entregue primero el slot mas bajo
+	for (k = POOL_REFILL - 1; k >= 0; k--)
+		pool->free[pool->countFree++] = slot + k;
+	pool->countCreated += POOL_REFILL;
+	return 0;
+}
+
+/**
+ * Entrega un objeto del pool de su tipo, sin retype si hay alguno libre
+ * @type seL4_TCBObject, seL4_EndpointObject o seL4_NotificationObject
+ * @return capacidad del objeto, seL4_CapNull e.o.c
+ */
+seL4_CPtr pool_get(seL4_Word type) {
+
+	struct ObjectPool *pool = pool_of(type);
+
+	if (pool == NULL)
+		return seL4_CapNull;
+	if (pool->countFree == 0 && pool_refill(pool) != 0)
+		return seL4_CapNull;
+	pool->used[pool->countUsed++] = pool->free[--pool->countFree];
+	return pool->used[pool->countUsed - 1];
+}
+
+/**
+ * Devuelve al pool un objeto entregado por pool_get() para reutilizarlo.
+ * Se revocan las copias de su capacidad que se hayan repartido; un TCB
+ * ademas se suspende (sale de las colas de IPC y del planificador) y se
+ * desliga de su notification. Los endpoints y notifications deben
+ * devolverse despues de suspender los hilos que los usaban, para que no
+ * quede ninguno esperando en ellos. Una capacidad que el pool no ha
+ * entregado, o que ya se ha devuelto, se rechaza: si no, el mismo objeto
+ * acabaria dos veces en free[] y se entregaria a dos dueños
+ * @cap capacidad original del objeto
+ * @type tipo del objeto
+ * @return 0 en ejecucion correcta, 3 si el pool no ha entregado cap, !0 e.o.c
+ */
+int pool_put(seL4_CPtr cap, seL4_Word type) {
+
+	int i;
+	struct ObjectPool *pool = pool_of(type);
+
+	if (pool == NULL || pool->countFree == POOL_MAX_OBJECTS)
+		return 1;
+	for (i = 0; i < pool->countUsed && pool->used[i] != cap; i++)
+		;
+	if (i == pool->countUsed) {
+		printf("ERROR: El objeto 0x%08x no lo ha entregado el pool o ya se ha devuelto\n", (unsigned int) cap);
+		return 3;
+	}
+	if (type == seL4_TCBObject) {
+		seL4_TCB_Suspend(cap);
+		seL4_TCB_UnbindNotification(cap);
+	}
+	if (seL4_CNode_Revoke(cspace.root, cap, seL4_WordBits) != seL4_NoError) {
+		printf("ERROR: No se ha podido reciclar el objeto 0x%08x\n", (unsigned int) cap);
+		return 2;
+	}
+	pool->used[i] = pool->used[--pool->countUsed];
+	pool->free[pool->countFree++] = cap;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  RESERVA DE OBJETOS POR TIPO
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Pasa count objetos del pool a los slots first..first+count-1, moviendo
+ * sus capacidades con cnode_batch() en tandas de OBJECT_MOVE_BATCH
+ * @pool pool del tipo de objeto
+ * @first primer slot del rango destino
+ * @count numero de objetos
+ * @return numero de objetos movidos (count en ejecucion correcta)
+ */
+int object_from_pool(struct ObjectPool *pool, seL4_CPtr first, int count) {
+
+	struct CNodeOp ops[OBJECT_MOVE_BATCH];
+	int moved = 0, n, k, done;
+
+	while (pool->countFree < count)
+		if (pool_refill(pool) != 0)
+			return 0;
+	while (moved < count) {
+		n = count - moved < OBJECT_MOVE_BATCH ? count - moved : OBJECT_MOVE_BATCH;
+		for (k = 0; k < n; k++) {
+			ops[k].op = CNODE_OP_MOVE;
+			ops[k].src = pool->free[pool->countFree - 1 - k];
+			ops[k].dest = first + moved + k;
+		}
+		done = cnode_batch(ops, n, NULL);
+		// los slots del pool que se han movido quedan vacios, y el objeto
+		// pasa a estar entregado en su slot destino
+		pool->countFree -= done;
+		for (k = 0; k < done; k++) {
+			free_slots(ops[k].src, 1);
+			pool->used[pool->countUsed++] = ops[k].dest;
+		}
+		moved += done;
+		if (done < n)
+			break;
+	}
+	return moved;
+}
+
+/**
+ * Crea count objetos en los slots first..first+count-1. count se divide en
+ * potencias de 2 (sus bits a 1) y cada trozo sale de un untyped de su
+ * tamaño exacto, alineado de forma natural, con un solo retype; los trozos
+ * de paginas grandes salen asi de nodos de 2^seL4_LargePageBits del arbol
+ * @type tipo de objeto seL4
+ * @objBits log2 del tamaño del objeto
+ * @first primer slot del rango destino
+ * @count numero de objetos
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int object_from_untyped(seL4_Word type, seL4_Uint8 objBits, seL4_CPtr first, int count) {
+
+	int b, node, start = objectChunks.countChunks;
+	seL4_CPtr slot = first;
+	struct ObjectDesc desc;
+
+	for (b = CONFIG_ROOT_CNODE_SIZE_BITS; b >= 0; b--) {
+		if (!(count & (1 << b)))
+			continue;
+		if (objectChunks.countChunks == MAX_OBJECT_CHUNKS) {
+			printf("ERROR: No caben mas trozos de objetos\n");
+			break;
+		}
+		node = untyped_reserve(objBits + b);
+		if (node < 0)
+			break;
+		desc.type = type;
+		desc.sizeBits = 0;
+		desc.count = 1 << b;
+		if (retype_batch(untypedTree.nodes[node].cap, &desc, 1, slot) != 0) {
+			untyped_unreserve(node);
+			break;
+		}
+		objectChunks.chunks[objectChunks.countChunks].first = slot;
+		objectChunks.chunks[objectChunks.countChunks].count = 1 << b;
+		objectChunks.chunks[objectChunks.countChunks].node = node;
+		objectChunks.countChunks++;
+		slot += 1 << b;
+	}
+	if (b < 0)
+		return 0;
+	// deshacer los trozos ya creados
+	while (objectChunks.countChunks > start)
+		untyped_unreserve(objectChunks.chunks[--objectChunks.countChunks].node);
+	return 1;
+}
+
+/**
+ * Reserva count objetos de un tipo en un rango de slots consecutivos. El
+ * tamaño y la alineacion salen de object_size_bits(), como getObjectSize()
+ * del kernel: los TCBs, endpoints y notifications salen de su pool y el
+ * resto (frames, tablas de paginas...) de untyped de tamaño exacto
+ * @type tipo de objeto seL4 de tamaño fijo (no untyped ni CNode)
+ * @count numero de objetos (como mucho CNODE_SLOTS)
+ * @return primer slot del rango con los objetos, seL4_CapNull e.o.c
+ */
+seL4_CPtr allocate_object(seL4_Word type, int count) {
+
+	seL4_CPtr first;
+	seL4_Uint8 objBits = object_size_bits(type, 0);
+	struct ObjectPool *pool = pool_of(type);
+	int k, done;
+
+	if (count <= 0 || count > CNODE_SLOTS || objBits == 0 || type == seL4_UntypedObject || type == seL4_CapTableObject) {
+		printf("ERROR: allocate_object() no admite %d objetos de tipo %d\n", count, (int) type);
+		return seL4_CapNull;
+	}
+	first = get_free_slots(count);
+	if (first == seL4_CapNull)
+		return seL4_CapNull;
+	if (pool != NULL) {
+		done = object_from_pool(pool, first, count);
+		// si falta alguno, los ya movidos vuelven al pool
+		for (k = 0; done < count && k < done; k++)
+			pool_put(first + k, type);
+	} else {
+		done = object_from_untyped(type, objBits, first, count) ? 0 : count;
+	}
+	if (done < count) {
+		printf("ERROR: No se han podido reservar %d objetos de tipo %d\n", count, (int) type);
+		free_slots(first + done, count - done);
+		return seL4_CapNull;
+	}
+	return first;
+}
+
+/**
+ * Devuelve count objetos reservados con allocate_object(). Los de pool se
+ * reciclan en su pool (sus slots pasan a ser del pool); el resto se borra
+ * revocando el untyped de cada trozo, que vuelve a la region gestionada
+ * @first primer slot del rango
+ * @type tipo de los objetos
+ * @count numero de objetos
+ * @return 0 en ejecucion correcta, !0 si el rango no coincide con lo reservado
+ */
+int release_object(seL4_CPtr first, seL4_Word type, int count) {
+
+	int i, k, error = 0, released = 0;
+	struct ObjectChunk *chunk;
+
+	if (pool_of(type) != NULL) {
+		for (k = 0; k < count; k++)
+			if (pool_put(first + k, type) != 0)
+				error = 1;
+		return error;
+	}
+	for (i = 0; i < objectChunks.countChunks; i++) {
+		chunk = &objectChunks.chunks[i];
+		if (chunk->first < first || chunk->first + chunk->count > first + count)
+			continue;
+		untyped_unreserve(chunk->node);
+		free_slots(chunk->first, chunk->count);
+		released += chunk->count;
+		*chunk = objectChunks.chunks[--objectChunks.countChunks];
+		i--;
+	}
+	return released != count;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  RESERVA DISPERSA (EXTENTS)
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Busca el mayor bloque libre de 2^k bytes, con k <= maxBits, alineado a su
+ * tamaño y dentro de un solo untyped raiz, de modo que map_extents() pueda
+ * obtener su untyped con untyped_get()
+ * @maxBits tamaño maximo del bloque
+ * @paddr donde se devuelve el inicio del bloque
+ * @return k, 0 si no queda libre ningun bloque de una pagina
+ */
+seL4_Uint8 extent_find_block(seL4_Uint8 maxBits, seL4_Word *paddr) {
+
+	int i, n;
+	seL4_Uint8 k, best = 0;
+	seL4_Word lo, hi, x;
+	struct Region *region;
+	struct UntypedNode *root;
+
+	for (i = 0; i < maxMemoryRegionAllocates.countRegions; i++) {
+		region = &maxMemoryRegionAllocates.regions[i];
+		if (region->isAllocated)
+			continue;
+		for (n = 0; n < untypedTree.countRoots; n++) {
+			// parte de la region libre que cae dentro de la raiz
+			root = &untypedTree.nodes[n];
+			lo = region->paddr > root->paddr ? region->paddr : root->paddr;
+			hi = root->paddr + ((seL4_Word) 1 << root->sizeBits);
+			if (region->paddr + region->sizeBitsPow < hi)
+				hi = region->paddr + region->sizeBitsPow;
+			// solo se prueban los tamaños que mejoran best
+			for (k = maxBits < root->sizeBits ? maxBits : root->sizeBits; k > best && k >= seL4_PageBits; k--) {
+				x = (lo + ((seL4_Word) 1 << k) - 1) & ~(((seL4_Word) 1 << k) - 1);
+				if (x + ((seL4_Word) 1 << k) <= hi) {
+					best = k;
+					*paddr = x;
+				}
+			}
+			if (best == maxBits)
+				return best;
+		}
+	}
+	return best;
+}
+
+/**
+ * Reserva para un cliente size bytes (redondeado a 4 KiB) en trozos
+ * alineados a su tamaño, cogiendo siempre el mayor que quede para usar los
+ * menos posibles. No necesita que ninguna region libre sea tan grande como
+ * la reserva. Los trozos salen de mayor a menor, de modo que cada uno queda
+ * tambien alineado a su tamaño dentro del rango virtual de map_extents()
+ * @client identificador del cliente (ROOT_CLIENT para Root_task)
+ * @size tamaño en bytes, mayor que 0
+ * @extents[] donde se devuelven los trozos
+ * @maxExtents numero maximo de trozos que caben en extents[]
+ * @return numero de trozos, -1 e.o.c con msg de error
+ */
+int allocate_extents(seL4_Word client, seL4_Word size, struct Extent *extents, int maxExtents) {
+
+	int count = 0;
+	seL4_Uint8 bits;
+	seL4_Word paddr, left, pageMask = ((seL4_Word) 1 << seL4_PageBits) - 1;
+
+	if (size == 0 || size > ~pageMask) {
+		printf("ERROR: allocate_extents(%lu) tamaño no valido\n", (unsigned long) size);
+		return -1;
+	}
+	size = (size + pageMask) & ~pageMask;
+	if (account_charge(client, size, FALSE) < 0) {
+		printf("ERROR: allocate_extents(%lu) supera el limite del cliente %d\n", (unsigned long) size, (int) client);
+		return -1;
+	}
+	for (left = size; left > 0; left -= (seL4_Word) 1 << bits) {
+		bits = seL4_WordBits - 1 - __builtin_clzl(left);
+		if (bits > 31)
+			bits = 31;	// el tamaño de una region es un unsigned int
+		bits = count < maxExtents ? extent_find_block(bits, &paddr) : 0;
+		// con OWNER_EXTENT el cliente no puede liberar un trozo suelto con MEMSRV_RELEASE
+		if (bits == 0 || reserve_region(&maxMemoryRegionAllocates, paddr, (seL4_Word) 1 << bits, client | OWNER_EXTENT) != 0) {
+			while (count > 0)
+				release_region(&maxMemoryRegionAllocates, extents[--count].paddr, client | OWNER_EXTENT, NULL);
+			account_uncharge(client, size, FALSE);
+			printf("ERROR: No se ha podido efectuar la reserva de memoria allocate_extents(%lu)\n", (unsigned long) size);
+			pressure_reclaim();
+			return -1;
+		}
+		extents[count].paddr = paddr;
+		extents[count].sizeBits = bits;
+		count++;
+	}
+	pressure_charge(size);
+	return count;
+}
+
+/**
+ * Quita del VSpace un lote de extentMaps. Revocar su untyped borra sus
+ * frames, y con ellos sus mapeos. El ultimo lote pasa a ocupar su sitio
+ * @i indice del lote en extentMaps.maps[]
+ */
+void extent_unmap(int i) {
+
+	untyped_put(extentMaps.maps[i].node);
+	free_slots(extentMaps.maps[i].frames, extentMaps.maps[i].countFrames);
+	extentMaps.maps[i] = extentMaps.maps[--extentMaps.countMaps];
+}
+
+/**
+ * Quita del VSpace los lotes mapeados con map_extents() de los trozos de
+ * una reserva dispersa
+ * @client identificador del cliente que la reservo
+ * @extents[] trozos de la reserva
+ * @count numero de trozos
+ */
+void unmap_extents(seL4_Word client, struct Extent *extents, int count) {
+
+	int i, j;
+	struct ExtentMap *map;
+
+	// de atras hacia delante, porque extent_unmap() mueve el ultimo lote
+	for (i = extentMaps.countMaps - 1; i >= 0; i--) {
+		map = &extentMaps.maps[i];
+		for (j = 0; j < count; j++) {
+			if (map->client == client && map->paddr >= extents[j].paddr && map->paddr < extents[j].paddr + ((seL4_Word) 1 << extents[j].sizeBits)) {
+				extent_unmap(i);
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Crea y mapea los frames de un lote de un trozo, con como mucho
+ * CNODE_SLOTS frames, y lo apunta en extentMaps aunque falle para que
+ * unmap_extents() lo deshaga
+ * @client identificador del cliente que reservo el trozo
+ * @paddr inicio del lote, alineado a su tamaño
+ * @sizeBits tamaño del lote (2^sizeBits)
+ * @frameBits tamaño de cada frame (seL4_PageBits o seL4_LargePageBits)
+ * @vspace capacidad del VSpace destino
+ * @vaddr direccion virtual del lote
+ * @rights derechos de acceso del mapeo
+ * @return seL4_NoError en ejecucion correcta, error seL4 e.o.c
+ */
+seL4_Error extent_map_batch(seL4_Word client, seL4_Word paddr, seL4_Uint8 sizeBits, seL4_Uint8 frameBits, seL4_CPtr vspace, seL4_Word vaddr, seL4_CapRights_t rights) {
+
+	int node, frames = 1 << (sizeBits - frameBits), mapped = 0;
+	seL4_CPtr slots;
+	struct ObjectDesc desc;
+	seL4_Error error;
+
+	if (extentMaps.countMaps == MAX_EXTENT_MAPS)
+		return seL4_NotEnoughMemory;
+	node = untyped_get(paddr, sizeBits);
+	if (node < 0)
+		return seL4_NotEnoughMemory;
+	slots = get_free_slots(frames);
+	if (slots == seL4_CapNull) {
+		untyped_put(node);
+		return seL4_NotEnoughMemory;
+	}
+	extentMaps.maps[extentMaps.countMaps].client = client;
+	extentMaps.maps[extentMaps.countMaps].paddr = paddr;
+	extentMaps.maps[extentMaps.countMaps].node = node;
+	extentMaps.maps[extentMaps.countMaps].frames = slots;
+	extentMaps.maps[extentMaps.countMaps].countFrames = frames;
+	extentMaps.countMaps++;
+	desc.type = frameBits == seL4_LargePageBits ? seL4_X86_LargePageObject : seL4_X86_4K;
+	desc.sizeBits = 0;
+	desc.count = frames;
+	error = retype_batch(untypedTree.nodes[node].cap, &desc, 1, slots);
+	while (error == seL4_NoError && mapped < frames) {
+		mapped += map_frames(slots + mapped, frames - mapped, vspace, vaddr + ((seL4_Word) mapped << frameBits), frameBits, rights, &error);
+		// falta la page table (o el page directory de una pagina grande)
+		if (error == seL4_FailedLookup)
+			error = map_paging_structure(vspace, frameBits == seL4_PageBits ? 0 : 1, vaddr + ((seL4_Word) mapped << frameBits));
+	}
+	return error;
+}
+
+/**
+ * Mapea los trozos de una reserva dispersa uno detras de otro en vspace a
+ * partir de vaddr, de modo que la reserva se vea contigua, creando las
+ * estructuras de paginacion que falten. Los trozos de 2 MiB o mas se mapean
+ * con paginas grandes si vaddr esta alineada a 2 MiB, y los que tienen mas
+ * de CNODE_SLOTS frames en lotes de CNODE_SLOTS. Si falla, deshace todo lo
+ * mapeado
+ * @client identificador del cliente que la reservo
+ * @extents[] trozos devueltos por allocate_extents()
+ * @count numero de trozos
+ * @vspace capacidad del VSpace destino
+ * @vaddr direccion virtual del primer trozo, alineada a pagina
+ * @rights derechos de acceso del mapeo
+ * @return seL4_NoError en ejecucion correcta, error seL4 e.o.c
+ */
+seL4_Error map_extents(seL4_Word client, struct Extent *extents, int count, seL4_CPtr vspace, seL4_Word vaddr, seL4_CapRights_t rights) {
+
+	int i;
+	seL4_Uint8 frameBits, batchBits;
+	seL4_Word offset, size;
+	seL4_Error error = seL4_NoError;
+
+	for (i = 0; i < count; i++) {
+		frameBits = seL4_PageBits;
+		if (extents[i].sizeBits >= seL4_LargePageBits && (vaddr & (((seL4_Word) 1 << seL4_LargePageBits) - 1)) == 0)
+			frameBits = seL4_LargePageBits;
+		batchBits = frameBits + CONFIG_ROOT_CNODE_SIZE_BITS;
+		if (batchBits > extents[i].sizeBits)
+			batchBits = extents[i].sizeBits;
+		size = (seL4_Word) 1 << extents[i].sizeBits;
+		for (offset = 0; error == seL4_NoError && offset < size; offset += (seL4_Word) 1 << batchBits)
+			error = extent_map_batch(client, extents[i].paddr + offset, batchBits, frameBits, vspace, vaddr + offset, rights);
+		if (error != seL4_NoError) {
+			printf("ERROR: No se ha podido mapear el trozo %d de la reserva dispersa (error %d)\n", i, error);
+			unmap_extents(client, extents, i + 1);
+			return error;
+		}
+		vaddr += size;
+	}
+	return seL4_NoError;
+}
+
+/**
+ * Libera una reserva dispersa de un cliente, quitando antes del VSpace los
+ * trozos que esten mapeados
+ * @client identificador del cliente que la reservo
+ * @extents[] trozos de la reserva
+ * @count numero de trozos
+ * @return 0 en ejecucion correcta, numero de trozos que no se han podido liberar e.o.c
+ */
+int release_extents(seL4_Word client, struct Extent *extents, int count) {
+
+	int i, error = 0;
+	unsigned int size;
+
+	unmap_extents(client, extents, count);
+	for (i = 0; i < count; i++) {
+		if (release_region(&maxMemoryRegionAllocates, extents[i].paddr, client | OWNER_EXTENT, &size) != 0) {
+			error++;
+		} else {
+			account_uncharge(client, size, FALSE);
+			pressure_credit(size);
+		}
+	}
+	return error;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  SERVIDOR DE MEMORIA
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Calcula el estado de la memoria gestionada recorriendo las regiones
+ * @stat estructura donde se devuelve el resultado
+ */
+void memory_stat(struct MemoryStat *stat) {
+
+	int i;
+
+	stat->freeBytes = 0;
+	stat->largestFree = 0;
+	stat->allocatedBytes = 0;
+	stat->countRegions = maxMemoryRegionAllocates.countRegions;
+	for (i = 0; i < maxMemoryRegionAllocates.countRegions; i++) {
+		if (maxMemoryRegionAllocates.regions[i].isAllocated) {
+			stat->allocatedBytes += maxMemoryRegionAllocates.regions[i].sizeBitsPow;
+		} else {
+			stat->freeBytes += maxMemoryRegionAllocates.regions[i].sizeBitsPow;
+			if (maxMemoryRegionAllocates.regions[i].sizeBitsPow > stat->largestFree)
+				stat->largestFree = maxMemoryRegionAllocates.regions[i].sizeBitsPow;
+		}
+	}
+}
+
+/**
+ * Crea el endpoint del servidor de memoria
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int memory_server_init(void) {
+
+	memServerEndpoint = create_object(seL4_EndpointObject, 0);
+	if (memServerEndpoint == seL4_CapNull)
+		return 1;
+	// los timbres de los anillos llegan por seL4_Recv sobre el endpoint
+	memServerNotification = create_object(seL4_NotificationObject, 0);
+	if (memServerNotification == seL4_CapNull || seL4_TCB_BindNotification(seL4_CapInitThreadTCB, memServerNotification) != seL4_NoError)
+		return 2;
+	clientRings.countRings = 0;
+	return 0;
+}
+
+/**
+ * Crea una capacidad del endpoint del servidor con el badge de un cliente,
+ * para entregarsela al proceso cliente. El badge identifica al cliente en
+ * cada peticion y su cuenta de memoria, por lo que debe ser unico y estar
+ * entre 1 y MAX_CLIENTS-1. Se le añade CLIENT_BADGE_FLAG para no
+ * confundirlo con los bits de los timbres. Una vez copiada al CSpace del
+ * cliente, hay que devolver el slot con cap_discard()
+ * @badge identificador del cliente
+ * @return slot con la capacidad con badge, seL4_CapNull e.o.c
+ */
+seL4_CPtr memory_server_mint_client(seL4_Word badge) {
+
+	seL4_CPtr slot;
+
+	if (badge == ROOT_CLIENT || badge >= MAX_CLIENTS) {
+		printf("ERROR: El badge de cliente debe estar entre 1 y %d\n", MAX_CLIENTS - 1);
+		return seL4_CapNull;
+	}
+	slot = get_free_slot();
+	if (slot == seL4_CapNull)
+		return seL4_CapNull;
+	if (seL4_CNode_Mint(cspace.root, slot, seL4_WordBits, cspace.root, memServerEndpoint, seL4_WordBits, seL4_AllRights, badge | CLIENT_BADGE_FLAG) != seL4_NoError) {
+		printf("ERROR: No se ha podido crear la capacidad del cliente %d\n", (int) badge);
+		free_slots(slot, 1);
+		return seL4_CapNull;
+	}
+	return slot;
+}
+
+/**
+ * Registra un anillo nuevo: crea su frame, lo mapea en Root_task y deja en
+ * el slot devuelto una copia del frame para transferirsela al cliente (el
+ * servidor la borra despues de la respuesta)
+ * @client cliente al que se cobran las peticiones del anillo
+ * @index indice asignado al anillo
+ * @return slot con la copia del frame para el cliente, seL4_CapNull e.o.c
+ */
+seL4_CPtr ring_register(seL4_Word client, int *index) {
+
+	int i;
+	seL4_CPtr frame, copy;
+	seL4_Word vaddr;
+
+	// reutilizar el indice de un anillo dado de baja
+	for (i = 0; i < clientRings.countRings && clientRings.ring[i] != NULL; i++)
+		;
+	if (i == MAX_CLIENT_RINGS) {
+		printf("ERROR: No se pueden registrar mas de %d anillos\n", MAX_CLIENT_RINGS);
+		return seL4_CapNull;
+	}
+	frame = create_object(seL4_X86_4K, 0);
+	if (frame == seL4_CapNull)
+		return seL4_CapNull;
+	copy = get_free_slot();
+	if (copy == seL4_CapNull) {
+		cap_discard(frame);
+		return seL4_CapNull;
+	}
+	vaddr = RING_VADDR_BASE + ((seL4_Word) i << seL4_PageBits);
+	if (map_page(frame, vaddr) != seL4_NoError || seL4_CNode_Copy(cspace.root, copy, seL4_WordBits, cspace.root, frame, seL4_WordBits, seL4_AllRights) != seL4_NoError) {
+		printf("ERROR: No se ha podido preparar el anillo %d\n", i);
+		// borrar el frame tambien lo quita del VSpace si se llego a mapear
+		free_slots(copy, 1);
+		cap_discard(frame);
+		return seL4_CapNull;
+	}
+	// el frame viene a cero del retype: indices y entradas ya inicializados
+	*index = i;
+	clientRings.ring[i] = (struct MemsrvRing *) vaddr;
+	clientRings.frame[i] = frame;
+	clientRings.client[i] = client;
+	if (i == clientRings.countRings)
+		clientRings.countRings++;
+	return copy;
+}
+
+/**
+ * Da de baja un anillo: revoca las copias del frame (el cliente deja de
+ * verlo) y borra el frame, que se desmapea de Root_task. Un timbre antiguo
+ * del anillo solo puede provocar un ring_drain() de mas
+ * @i indice del anillo
+ */
+void ring_unregister(int i) {
+
+	seL4_CNode_Revoke(cspace.root, clientRings.frame[i], seL4_WordBits);
+	cap_discard(clientRings.frame[i]);
+	clientRings.ring[i] = NULL;
+	clientRings.frame[i] = seL4_CapNull;
+	clientRings.client[i] = MAX_CLIENTS;
+}
+
+/**
+ * Crea el timbre de un anillo: una capacidad de la notification del
+ * servidor con badge 2^index. Solo lo puede pedir el cliente del anillo
+ * @client cliente que pide el timbre
+ * @index indice del anillo
+ * @return slot con el timbre para el cliente, seL4_CapNull e.o.c
+ */
+seL4_CPtr ring_doorbell(seL4_Word client, seL4_Word index) {
+
+	seL4_CPtr slot;
+
+	if (index >= clientRings.countRings || clientRings.ring[index] == NULL || clientRings.client[index] != client) {
+		printf("ERROR: El anillo %d no es del cliente %d\n", (int) index, (int) client);
+		return seL4_CapNull;
+	}
+	slot = get_free_slot();
+	if (slot == seL4_CapNull)
+		return seL4_CapNull;
+	if (seL4_CNode_Mint(cspace.root, slot, seL4_WordBits, cspace.root, memServerNotification, seL4_WordBits, seL4_AllRights, (seL4_Word) 1 << index) != seL4_NoError) {
+		free_slots(slot, 1);
+		return seL4_CapNull;
+	}
+	return slot;
+}
+
+/**
+ * Registra a un cliente para recibir avisos de falta de memoria. La primera
+ * vez crea su notification; si ya se esta recuperando memoria, le avisa en
+ * el acto
+ * @client identificador del cliente
+ * @return slot con una copia de la notification para transferirsela (el
+ *         servidor la borra despues de la respuesta), seL4_CapNull e.o.c
+ */
+seL4_CPtr pressure_register(seL4_Word client) {
+
+	seL4_CPtr copy;
+
+	if (client >= MAX_CLIENTS)
+		return seL4_CapNull;
+	if (pressure.notification[client] == seL4_CapNull)
+		pressure.notification[client] = create_object(seL4_NotificationObject, 0);
+	if (pressure.notification[client] == seL4_CapNull)
+		return seL4_CapNull;
+	copy = get_free_slot();
+	if (copy == seL4_CapNull)
+		return seL4_CapNull;
+	if (seL4_CNode_Copy(cspace.root, copy, seL4_WordBits, cspace.root, pressure.notification[client], seL4_WordBits, seL4_AllRights) != seL4_NoError) {
+		free_slots(copy, 1);
+		return seL4_CapNull;
+	}
+	if (pressure.reclaiming)
+		seL4_Signal(pressure.notification[client]);
+	return copy;
+}
+
+/**
+ * Recupera toda la memoria de un cliente, al terminar o para reducirlo.
+ * Revoca todos sus sub-arenas con untyped_put_batch() y devuelve todas sus
+ * regiones, con o sin marca OWNER_TAGS, con una sola pasada de
+ * release_owner(), en lugar de un release() por region. Da tambien de baja
+ * sus anillos, su notification de aviso, sus handles y los mapeos de sus
+ * reservas dispersas, de modo que otro cliente con el mismo badge empiece
+ * de cero
+ * @client identificador del cliente
+ * @return bytes recuperados
+ */
+seL4_Word reclaim_client(seL4_Word client) {
+
+	int nodes[MAX_SUB_ARENAS];
+	int countNodes = 0, i, j = 0;
+	seL4_Word bytes;
+
+	if (client == ROOT_CLIENT || client >= MAX_CLIENTS)
+		return 0;
+	for (i = 0; i < clientRings.countRings; i++)
+		if (clientRings.ring[i] != NULL && clientRings.client[i] == client)
+			ring_unregister(i);
+	if (pressure.notification[client] != seL4_CapNull) {
+		// revocar borra las copias que tiene el cliente
+		seL4_CNode_Revoke(cspace.root, pressure.notification[client], seL4_WordBits);
+		cap_discard(pressure.notification[client]);
+		pressure.notification[client] = seL4_CapNull;
+	}
+	handle_drop_client(client);
+	// quitar del VSpace sus reservas dispersas antes de liberar su memoria
+	for (i = extentMaps.countMaps - 1; i >= 0; i--)
+		if (extentMaps.maps[i].client == client)
+			extent_unmap(i);
+	// sacar sus sub-arenas de la lista compactandola en la misma pasada
+	for (i = 0; i < subArenas.countArenas; i++) {
+		if (subArenas.arenas[i].client == client)
+			nodes[countNodes++] = subArenas.arenas[i].node;
+		else
+			subArenas.arenas[j++] = subArenas.arenas[i];
+	}
+	subArenas.countArenas = j;
+	untyped_put_batch(nodes, countNodes);
+	release_owner(&maxMemoryRegionAllocates, client, ~OWNER_TAGS, &bytes);
+	accounts[client].inUse = 0;
+	accounts[client].reserved = 0;
+	pressure_credit(bytes);
+	return bytes;
+}
+
+/**
+ * Atiende todas las peticiones pendientes de los anillos que han tocado el
+ * timbre. Si un anillo de finalizacion se llena, sus peticiones restantes
+ * quedan para el siguiente aviso del cliente
+ * @bits palabra de la notification (un bit por anillo)
+ */
+void ring_drain(seL4_Word bits) {
+
+	int i;
+	struct MemsrvRing *ring;
+	struct MemsrvSubmission *sqe;
+	struct MemsrvCompletion *cqe;
+	seL4_Word head, tail, cqTail;
+
+	for (i = 0; i < clientRings.countRings; i++) {
+		if (!(bits & ((seL4_Word) 1 << i)) || clientRings.ring[i] == NULL)
+			continue;
+		ring = clientRings.ring[i];
+		head = ring->sqHead;
+		tail = __atomic_load_n(&ring->sqTail, __ATOMIC_ACQUIRE);
+		cqTail = ring->cqTail;
+		while (head != tail && cqTail - __atomic_load_n(&ring->cqHead, __ATOMIC_ACQUIRE) < MEMSRV_RING_ENTRIES) {
+			sqe = &ring->sq[head & (MEMSRV_RING_ENTRIES - 1)];
+			cqe = &ring->cq[cqTail & (MEMSRV_RING_ENTRIES - 1)];
+			cqe->userData = sqe->userData;
+			cqe->value = 0;
+			if (sqe->op == MEMSRV_ALLOCATE && sqe->arg > 0 && sqe->arg <= 31) {
+				cqe->value = allocate_client(clientRings.client[i], (seL4_Uint8) sqe->arg);
+				if (cqe->value)
+					cqe->result = MEMSRV_OK;
+				else
+					cqe->result = account_exceeds(clientRings.client[i], (seL4_Word) 1 << sqe->arg, TRUE) ? MEMSRV_EQUOTA : MEMSRV_ENOMEM;
+			} else if (sqe->op == MEMSRV_RELEASE) {
+				cqe->result = release_client(clientRings.client[i], sqe->arg) ? MEMSRV_EINVAL : MEMSRV_OK;
+			} else {
+				cqe->result = MEMSRV_EINVAL;
+			}
+			head++;
+			cqTail++;
+		}
+		// publicar resultados y liberar huecos una sola vez por anillo
+		__atomic_store_n(&ring->cqTail, cqTail, __ATOMIC_RELEASE);
+		__atomic_store_n(&ring->sqHead, head, __ATOMIC_RELEASE);
+	}
+}
+
+/**
+ * Bucle del servidor de memoria: atiende peticiones allocate/release/stat
+ * de otros procesos (protocolo en memserver.h) y vacia los anillos de los
+ * clientes cuando tocan el timbre. No termina
+ */
+void memory_server_run(void) {
+
+	seL4_Word badge, client, paddr;
+	seL4_MessageInfo_t info;
+	struct MemoryStat stat;
+	seL4_CPtr cap, minted;
+	int result, length, index = 0;
+
+	info = seL4_Recv(memServerEndpoint, &badge);
+	while (TRUE) {
+		// sin CLIENT_BADGE_FLAG es la notification ligada: el badge son los timbres
+		if (!(badge & CLIENT_BADGE_FLAG)) {
+			ring_drain(badge);
+			info = seL4_Recv(memServerEndpoint, &badge);
+			continue;
+		}
+		client = badge & ~CLIENT_BADGE_FLAG;
+		length = 0;
+		cap = seL4_CapNull;
+		minted = seL4_CapNull;
+		switch (seL4_MessageInfo_get_label(info)) {
+		case MEMSRV_ALLOCATE:
+			// sizeBitsPow es unsigned int: tamaños de 2^1 a 2^31
+			if (seL4_GetMR(0) == 0 || seL4_GetMR(0) > 31) {
+				result = MEMSRV_EINVAL;
+				break;
+			}
+			paddr = allocate_client(client, (seL4_Uint8) seL4_GetMR(0));
+			if (paddr)
+				result = MEMSRV_OK;
+			else
+				result = account_exceeds(client, (seL4_Word) 1 << seL4_GetMR(0), TRUE) ? MEMSRV_EQUOTA : MEMSRV_ENOMEM;
+			seL4_SetMR(0, paddr);
+			seL4_SetMR(1, account_exceeds(client, 0, FALSE));
+			length = 2;
+			break;
+		case MEMSRV_RELEASE:
+			result = release_client(client, seL4_GetMR(0)) ? MEMSRV_EINVAL : MEMSRV_OK;
+			break;
+		case MEMSRV_RESIZE:
+			if (seL4_GetMR(1) == 0 || seL4_GetMR(1) > 31) {
+				result = MEMSRV_EINVAL;
+				break;
+			}
+			switch (resize_client(client, seL4_GetMR(0), (seL4_Uint8) seL4_GetMR(1))) {
+			case 0:
+				result = MEMSRV_OK;
+				break;
+			case 4:
+			case 5:
+				result = MEMSRV_ENOMEM;
+				break;
+			case 6:
+				result = MEMSRV_EQUOTA;
+				break;
+			case 7:
+				// tamaño no valido
+				result = MEMSRV_EINVAL;
+				break;
+			default:
+				// la region no es del cliente, como en MEMSRV_RELEASE
+				result = MEMSRV_EINVAL;
+			}
+			break;
+		case MEMSRV_STAT:
+			memory_stat(&stat);
+			seL4_SetMR(0, stat.freeBytes);
+			seL4_SetMR(1, stat.largestFree);
+			seL4_SetMR(2, stat.allocatedBytes);
+			seL4_SetMR(3, stat.countRegions);
+			result = MEMSRV_OK;
+			length = 4;
+			break;
+		case MEMSRV_QUOTA:
+			seL4_SetMR(0, accounts[client].inUse);
+			seL4_SetMR(1, accounts[client].reserved);
+			seL4_SetMR(2, accounts[client].softLimit);
+			seL4_SetMR(3, accounts[client].hardLimit);
+			result = MEMSRV_OK;
+			length = 4;
+			break;
+		case MEMSRV_RING_REGISTER:
+			cap = ring_register(client, &index);
+			minted = cap;
+			result = cap ? MEMSRV_OK : MEMSRV_ENOMEM;
+			seL4_SetMR(0, index);
+			length = 1;
+			break;
+		case MEMSRV_ARENA_CREATE:
+			if (seL4_GetMR(0) < seL4_PageBits || seL4_GetMR(0) > 31) {
+				result = MEMSRV_EINVAL;
+				break;
+			}
+			cap = subarena_create(client, (seL4_Uint8) seL4_GetMR(0), &paddr);
+			if (cap)
+				result = MEMSRV_OK;
+			else
+				result = account_exceeds(client, (seL4_Word) 1 << seL4_GetMR(0), TRUE) ? MEMSRV_EQUOTA : MEMSRV_ENOMEM;
+			seL4_SetMR(0, paddr);
+			length = 1;
+			break;
+		case MEMSRV_ARENA_RELEASE:
+			result = subarena_release(client, seL4_GetMR(0)) ? MEMSRV_EINVAL : MEMSRV_OK;
+			break;
+		case MEMSRV_PRESSURE_REGISTER:
+			cap = pressure_register(client);
+			minted = cap;
+			result = cap ? MEMSRV_OK : MEMSRV_ENOMEM;
+			break;
+		case MEMSRV_RING_DOORBELL:
+			cap = ring_doorbell(client, seL4_GetMR(0));
+			minted = cap;
+			result = cap ? MEMSRV_OK : MEMSRV_EINVAL;
+			break;
+		default:
+			result = MEMSRV_EINVAL;
+		}
+		if (cap != seL4_CapNull)
+			seL4_SetCap(0, cap);
+		info = seL4_ReplyRecv(memServerEndpoint, seL4_MessageInfo_new(result, 0, cap ? 1 : 0, length), &badge);
+		// la respuesta ya ha copiado la capacidad al cliente: el slot del servidor sobra
+		if (minted != seL4_CapNull)
+			cap_discard(minted);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//  MAIN - PRUEBAS DE EJECUCION
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Programa de pruebas
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int main(void) {
+
+	int i;
+
+    printf("\n\n>>>\n>>> Welcome to the SESO operating system\n>>>\n");
+    printf("============================================================\n");
+
+    boot_info = platsupport_get_bootinfo();
     print_bootinfo(boot_info);
+    init_slots();
     
     aligment = 64;               // Aineacion 8, 16, 32 o 64
     init_memory_system(aligment);
+    init_untyped_tree();
+    init_pressure();
+    init_slabs();
+    init_handles();
+    init_object_pools();
 
 	printf("Aligment: %d\n", aligment);
 	seL4_Word paddr1 = allocate(6);
@@ -512,6 +3457,21 @@ int main(void) {
     }
 	printf("------------------------------------------------------------\n");
 
+	// con handles la doble liberacion se detecta por la generacion, sin buscar
+	seL4_Word handle1 = allocate_handle(6);
+	printf("allocate_handle(6): 0x%08x -> 0x%08x\n", (unsigned int) handle1, (unsigned int) handle_paddr(handle1));
+	printf("release_handle(0x%08x)\n", (unsigned int) handle1);
+	release_handle(handle1);
+	printf("release_handle(0x%08x)\n", (unsigned int) handle1);
+	release_handle(handle1);
+	printf("------------------------------------------------------------\n");
+
+	if (MEMORY_SERVER_MODE) {
+		printf("Memory server mode\n");
+		if (memory_server_init() == 0)
+			memory_server_run();
+	}
+
     printf("============================================================\n");
     printf(">>> See you soon!\n\n");
 
@@ -0,0 +1,378 @@
+// Protocolo IPC del servidor de memoria de Root_task
+// Ingenieria Informatica UPV/EHU
+// Sistemas Operativos, 3er curso
+//============================================
+//
+// Todas las peticiones y respuestas caben en 4 registros de mensaje. Las que
+// no transfieren capacidades van por el fastpath del kernel con
+// seL4_Call/seL4_ReplyRecv; las que devuelven una capacidad
+// (MEMSRV_ARENA_CREATE, MEMSRV_PRESSURE_REGISTER, MEMSRV_RING_REGISTER y
+// MEMSRV_RING_DOORBELL) van por el slowpath. La etiqueta (label) del mensaje
+// es la operacion en la peticion y el codigo de resultado en la respuesta.
+//
+//   Operacion        Peticion                 Respuesta
+//   MEMSRV_ALLOCATE  MR0 sizeBits             MR0 paddr (0 si error), MR1 1 si se ha
+//                                             superado el limite blando
+//   MEMSRV_RELEASE   MR0 paddr                -
+//   MEMSRV_RESIZE    MR0 paddr, MR1 sizeBits  - (MEMSRV_ENOMEM si no puede crecer sin
+//                                             moverse: reservar otra, copiar y liberar)
+//   MEMSRV_STAT      -                        MR0 bytes libres, MR1 mayor region libre,
+//                                             MR2 bytes reservados, MR3 numero de regiones
+//   MEMSRV_QUOTA     -                        MR0 bytes en uso, MR1 bytes en sub-arenas,
+//                                             MR2 limite blando, MR3 limite duro
+//
+// Cada cliente tiene una cuenta de memoria asociada a su badge. Las reservas
+// (incluidos los sub-arenas) que superen su limite duro se rechazan con
+// MEMSRV_EQUOTA; el limite blando solo se notifica. Un cliente solo puede
+// liberar las regiones que ha reservado el mismo.
+//
+// Un cliente puede pedir un sub-arena: un untyped propio de 2^sizeBits sobre el
+// que hace sus reservas localmente con el mismo asignador (regions.c), sin
+// IPC. Al devolverlo el servidor revoca todo lo que el cliente haya creado:
+//
+//   MEMSRV_ARENA_CREATE   MR0 sizeBits        MR0 paddr, cap: untyped del sub-arena
+//   MEMSRV_ARENA_RELEASE  MR0 paddr           -
+//
+// Cuando la memoria libre baja de la marca baja, el servidor hace seL4_Signal()
+// sobre la notification de cada cliente registrado. El cliente deberia
+// devolver la memoria que tenga en cache hasta que el servidor recupere la
+// marca alta. El registro transfiere la notification:
+//
+//   MEMSRV_PRESSURE_REGISTER  -               cap: notification de aviso
+//
+// Para peticiones asincronas el cliente registra un par de anillos
+// (envio/finalizacion) en un frame compartido con el servidor. Estas dos
+// operaciones solo se usan al registrarse y si transfieren una capacidad:
+//
+//   MEMSRV_RING_REGISTER  -                   MR0 indice del anillo, cap: frame del anillo
+//   MEMSRV_RING_DOORBELL  MR0 indice          cap: notification (timbre) del anillo
+//
+// El cliente escribe MEMSRV_ALLOCATE/MEMSRV_RELEASE en el anillo de envio,
+// hace seL4_Signal() sobre el timbre y recoge los resultados del anillo de
+// finalizacion cuando le convenga (sondeo, sin bloquearse).
+
+#ifndef MEMSERVER_H
+#define MEMSERVER_H
+
+#include <stddef.h>
+#include <sel4/sel4.h>
+#include "regions.h"
+
+// Operaciones (label de la peticion)
+#define MEMSRV_ALLOCATE 1
+#define MEMSRV_RELEASE 2
+#define MEMSRV_STAT 3
+#define MEMSRV_RING_REGISTER 4
+#define MEMSRV_RING_DOORBELL 5
+#define MEMSRV_ARENA_CREATE 6
+#define MEMSRV_ARENA_RELEASE 7
+#define MEMSRV_QUOTA 8
+#define MEMSRV_PRESSURE_REGISTER 9
+#define MEMSRV_RESIZE 10
+
+// Resultados (label de la respuesta)
+#define MEMSRV_OK 0
+#define MEMSRV_ENOMEM 1
+#define MEMSRV_EINVAL 2
+#define MEMSRV_EQUOTA 3
+
+// Entradas de cada anillo (potencia de 2, el par cabe en un frame de 4 KiB)
+#define MEMSRV_RING_ENTRIES 64
+
+/**
+ * Peticion del anillo de envio
+ * @op MEMSRV_ALLOCATE o MEMSRV_RELEASE
+ * @arg sizeBits o paddr, igual que MR0 en la version sincrona
+ * @userData valor del cliente que se devuelve en la finalizacion
+ */
+struct MemsrvSubmission {
+    seL4_Word op;
+    seL4_Word arg;
+    seL4_Word userData;
+};
+
+/**
+ * Resultado del anillo de finalizacion
+ * @result MEMSRV_OK o codigo de error
+ * @value paddr reservado (MEMSRV_ALLOCATE), 0 e.o.c
+ * @userData userData de la peticion correspondiente
+ */
+struct MemsrvCompletion {
+    seL4_Word result;
+    seL4_Word value;
+    seL4_Word userData;
+};
+
+/**
+ * Par de anillos productor unico/consumidor unico compartido en un frame.
+ * Los indices crecen sin limite y se usan modulo MEMSRV_RING_ENTRIES; cada
+ * indice solo lo escribe un lado (el otro solo lo lee)
+ * @sqHead siguiente peticion a consumir (escribe el servidor)
+ * @sqTail siguiente hueco de peticion libre (escribe el cliente)
+ * @cqHead siguiente resultado a consumir (escribe el cliente)
+ * @cqTail siguiente hueco de resultado libre (escribe el servidor)
+ */
+struct MemsrvRing {
+    seL4_Word sqHead;
+    seL4_Word sqTail;
+    seL4_Word cqHead;
+    seL4_Word cqTail;
+    struct MemsrvSubmission sq[MEMSRV_RING_ENTRIES];
+    struct MemsrvCompletion cq[MEMSRV_RING_ENTRIES];
+};
+
+/**
+ * Sub-arena delegado, visto desde el cliente
+ * @untyped capacidad del untyped del sub-arena
+ * @paddr inicio del sub-arena
+ * @sizeBits tamaño del sub-arena (2^sizeBits)
+ * @regions lista de regiones del asignador local
+ */
+struct MemsrvArena {
+    seL4_CPtr untyped;
+    seL4_Word paddr;
+    seL4_Uint8 sizeBits;
+    struct Regions regions;
+};
+
+/**
+ * Pide al servidor una region de 2^sizeBits bytes
+ * @ep capacidad (con badge) del endpoint del servidor
+ * @sizeBits tamaño de la region
+ * @return paddr de la region reservada, 0 e.o.c
+ */
+static inline seL4_Word memsrv_allocate(seL4_CPtr ep, seL4_Uint8 sizeBits) {
+
+	seL4_Word mr0 = sizeBits, mr1 = 0, mr2 = 0, mr3 = 0;
+	seL4_MessageInfo_t info;
+
+	info = seL4_CallWithMRs(ep, seL4_MessageInfo_new(MEMSRV_ALLOCATE, 0, 0, 1), &mr0, &mr1, &mr2, &mr3);
+	if (seL4_MessageInfo_get_label(info) != MEMSRV_OK)
+		return 0;
+	return mr0;
+}
+
+/**
+ * Devuelve al servidor la region que empieza en paddr
+ * @ep capacidad (con badge) del endpoint del servidor
+ * @paddr inicio de la region a liberar
+ * @return MEMSRV_OK en ejecucion correcta, codigo de error e.o.c
+ */
+static inline int memsrv_release(seL4_CPtr ep, seL4_Word paddr) {
+
+	seL4_Word mr0 = paddr, mr1 = 0, mr2 = 0, mr3 = 0;
+	seL4_MessageInfo_t info;
+
+	info = seL4_CallWithMRs(ep, seL4_MessageInfo_new(MEMSRV_RELEASE, 0, 0, 1), &mr0, &mr1, &mr2, &mr3);
+	return seL4_MessageInfo_get_label(info);
+}
+
+/**
+ * Cambia sin moverla el tamaño de una region reservada al servidor
+ * @ep capacidad (con badge) del endpoint del servidor
+ * @paddr inicio de la region
+ * @sizeBits nuevo tamaño de la region
+ * @return MEMSRV_OK en ejecucion correcta, MEMSRV_ENOMEM si no hay sitio
+ * contiguo para crecer, otro codigo de error e.o.c
+ */
+static inline int memsrv_resize(seL4_CPtr ep, seL4_Word paddr, seL4_Uint8 sizeBits) {
+
+	seL4_Word mr0 = paddr, mr1 = sizeBits, mr2 = 0, mr3 = 0;
+	seL4_MessageInfo_t info;
+
+	info = seL4_CallWithMRs(ep, seL4_MessageInfo_new(MEMSRV_RESIZE, 0, 0, 2), &mr0, &mr1, &mr2, &mr3);
+	return seL4_MessageInfo_get_label(info);
+}
+
+/**
+ * Consulta el estado de la memoria gestionada por el servidor
+ * @ep capacidad (con badge) del endpoint del servidor
+ * @stat[] array de 4 palabras donde se copian MR0..MR3 de la respuesta
+ * @return MEMSRV_OK en ejecucion correcta, codigo de error e.o.c
+ */
+static inline int memsrv_stat(seL4_CPtr ep, seL4_Word stat[4]) {
+
+	seL4_MessageInfo_t info;
+
+	stat[0] = stat[1] = stat[2] = stat[3] = 0;
+	info = seL4_CallWithMRs(ep, seL4_MessageInfo_new(MEMSRV_STAT, 0, 0, 0), &stat[0], &stat[1], &stat[2], &stat[3]);
+	return seL4_MessageInfo_get_label(info);
+}
+
+/**
+ * Consulta la cuenta de memoria del cliente
+ * @ep capacidad (con badge) del endpoint del servidor
+ * @quota[] array de 4 palabras donde se copian MR0..MR3 de la respuesta
+ * @return MEMSRV_OK en ejecucion correcta, codigo de error e.o.c
+ */
+static inline int memsrv_quota(seL4_CPtr ep, seL4_Word quota[4]) {
+
+	seL4_MessageInfo_t info;
+
+	quota[0] = quota[1] = quota[2] = quota[3] = 0;
+	info = seL4_CallWithMRs(ep, seL4_MessageInfo_new(MEMSRV_QUOTA, 0, 0, 0), &quota[0], &quota[1], &quota[2], &quota[3]);
+	return seL4_MessageInfo_get_label(info);
+}
+
+/**
+ * Registra al cliente para recibir avisos de falta de memoria. Despues el
+ * cliente puede hacer seL4_Poll() o seL4_Wait() sobre la notification
+ * @ep capacidad (con badge) del endpoint del servidor
+ * @cnode CNode del cliente donde se recibe la notification
+ * @depth profundidad de slot dentro de cnode
+ * @slot slot vacio para la notification
+ * @return MEMSRV_OK en ejecucion correcta, codigo de error e.o.c
+ */
+static inline int memsrv_pressure_register(seL4_CPtr ep, seL4_CPtr cnode, seL4_Uint8 depth, seL4_CPtr slot) {
+
+	seL4_MessageInfo_t info;
+
+	seL4_SetCapReceivePath(cnode, slot, depth);
+	info = seL4_Call(ep, seL4_MessageInfo_new(MEMSRV_PRESSURE_REGISTER, 0, 0, 0));
+	return seL4_MessageInfo_get_label(info);
+}
+
+/**
+ * Pide al servidor un sub-arena de 2^sizeBits bytes (minimo una pagina) y
+ * prepara el asignador local sobre el
+ * @ep capacidad (con badge) del endpoint del servidor
+ * @cnode CNode del cliente donde se recibe el untyped
+ * @depth profundidad de slot dentro de cnode
+ * @slot slot vacio para el untyped
+ * @sizeBits tamaño del sub-arena
+ * @arena sub-arena a inicializar
+ * @return MEMSRV_OK en ejecucion correcta, codigo de error e.o.c
+ */
+static inline int memsrv_arena_create(seL4_CPtr ep, seL4_CPtr cnode, seL4_Uint8 depth, seL4_CPtr slot, seL4_Uint8 sizeBits, struct MemsrvArena *arena) {
+
+	seL4_MessageInfo_t info;
+
+	seL4_SetCapReceivePath(cnode, slot, depth);
+	seL4_SetMR(0, sizeBits);
+	info = seL4_Call(ep, seL4_MessageInfo_new(MEMSRV_ARENA_CREATE, 0, 0, 1));
+	if (seL4_MessageInfo_get_label(info) != MEMSRV_OK)
+		return seL4_MessageInfo_get_label(info);
+	arena->untyped = slot;
+	arena->paddr = seL4_GetMR(0);
+	arena->sizeBits = sizeBits;
+	init_regions(&arena->regions, arena->paddr, (seL4_Word) 1 << sizeBits);
+	return MEMSRV_OK;
+}
+
+/**
+ * Reserva localmente 2^sizeBits bytes del sub-arena, alineados a su tamaño
+ * para que puedan convertirse en un untyped hijo si hace falta
+ * @arena sub-arena del cliente
+ * @sizeBits tamaño de memoria a reservar
+ * @return paddr de la region reservada, 0 e.o.c
+ */
+static inline seL4_Word memsrv_arena_allocate(struct MemsrvArena *arena, seL4_Uint8 sizeBits) {
+
+	return allocate_region(&arena->regions, (seL4_Word) 1 << sizeBits, ((seL4_Word) 1 << sizeBits) - 1, 0);
+}
+
+/**
+ * Libera localmente una region del sub-arena
+ * @arena sub-arena del cliente
+ * @paddr inicio de la region
+ * @return 0 en ejecucion correcta, codigo de error e.o.c
+ */
+static inline int memsrv_arena_release(struct MemsrvArena *arena, seL4_Word paddr) {
+
+	return release_region(&arena->regions, paddr, 0, NULL);
+}
+
+/**
+ * Devuelve el sub-arena al servidor. El untyped del cliente y todo lo creado
+ * a partir de el deja de existir
+ * @ep capacidad (con badge) del endpoint del servidor
+ * @arena sub-arena a devolver
+ * @return MEMSRV_OK en ejecucion correcta, codigo de error e.o.c
+ */
+static inline int memsrv_arena_return(seL4_CPtr ep, struct MemsrvArena *arena) {
+
+	seL4_Word mr0 = arena->paddr, mr1 = 0, mr2 = 0, mr3 = 0;
+	seL4_MessageInfo_t info;
+
+	info = seL4_CallWithMRs(ep, seL4_MessageInfo_new(MEMSRV_ARENA_RELEASE, 0, 0, 1), &mr0, &mr1, &mr2, &mr3);
+	return seL4_MessageInfo_get_label(info);
+}
+
+/**
+ * Registra un par de anillos en el servidor. Recibe el frame del anillo y la
+ * capacidad del timbre en los slots indicados del CNode del cliente; despues
+ * el cliente debe mapear el frame para acceder a la struct MemsrvRing
+ * @ep capacidad (con badge) del endpoint del servidor
+ * @cnode CNode del cliente donde se reciben las capacidades
+ * @depth profundidad de los slots dentro de cnode
+ * @frameSlot slot vacio para el frame del anillo
+ * @doorbellSlot slot vacio para el timbre
+ * @return MEMSRV_OK en ejecucion correcta, codigo de error e.o.c
+ */
+static inline int memsrv_ring_register(seL4_CPtr ep, seL4_CPtr cnode, seL4_Uint8 depth, seL4_CPtr frameSlot, seL4_CPtr doorbellSlot) {
+
+	seL4_MessageInfo_t info;
+	seL4_Word index;
+
+	seL4_SetCapReceivePath(cnode, frameSlot, depth);
+	info = seL4_Call(ep, seL4_MessageInfo_new(MEMSRV_RING_REGISTER, 0, 0, 0));
+	if (seL4_MessageInfo_get_label(info) != MEMSRV_OK)
+		return seL4_MessageInfo_get_label(info);
+	index = seL4_GetMR(0);
+	seL4_SetCapReceivePath(cnode, doorbellSlot, depth);
+	seL4_SetMR(0, index);
+	info = seL4_Call(ep, seL4_MessageInfo_new(MEMSRV_RING_DOORBELL, 0, 0, 1));
+	return seL4_MessageInfo_get_label(info);
+}
+
+/**
+ * Encola una peticion en el anillo de envio (sin avisar al servidor)
+ * @ring anillo mapeado en el espacio del cliente
+ * @op MEMSRV_ALLOCATE o MEMSRV_RELEASE
+ * @arg sizeBits o paddr
+ * @userData valor que se devuelve en la finalizacion
+ * @return 0 si se ha encolado, !0 si el anillo esta lleno
+ */
+static inline int memsrv_ring_submit(struct MemsrvRing *ring, seL4_Word op, seL4_Word arg, seL4_Word userData) {
+
+	seL4_Word tail = ring->sqTail;
+	struct MemsrvSubmission *sqe;
+
+	if (tail - __atomic_load_n(&ring->sqHead, __ATOMIC_ACQUIRE) == MEMSRV_RING_ENTRIES)
+		return 1;
+	sqe = &ring->sq[tail & (MEMSRV_RING_ENTRIES - 1)];
+	sqe->op = op;
+	sqe->arg = arg;
+	sqe->userData = userData;
+	__atomic_store_n(&ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/**
+ * Avisa al servidor de que hay peticiones nuevas en el anillo. Un solo aviso
+ * basta para todas las peticiones encoladas desde el anterior
+ * @doorbell capacidad del timbre recibida en memsrv_ring_register()
+ */
+static inline void memsrv_ring_doorbell(seL4_CPtr doorbell) {
+
+	seL4_Signal(doorbell);
+}
+
+/**
+ * Saca un resultado del anillo de finalizacion si lo hay
+ * @ring anillo mapeado en el espacio del cliente
+ * @cqe donde se copia el resultado
+ * @return 0 si se ha sacado un resultado, !0 si no habia ninguno
+ */
+static inline int memsrv_ring_complete(struct MemsrvRing *ring, struct MemsrvCompletion *cqe) {
+
+	seL4_Word head = ring->cqHead;
+
+	if (head == __atomic_load_n(&ring->cqTail, __ATOMIC_ACQUIRE))
+		return 1;
+	*cqe = ring->cq[head & (MEMSRV_RING_ENTRIES - 1)];
+	__atomic_store_n(&ring->cqHead, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+#endif /* MEMSERVER_H */
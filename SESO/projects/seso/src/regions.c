@@ -0,0 +1,482 @@
+// Lista estatica de regiones de memoria ordenada por paddr
+// Ingenieria Informatica UPV/EHU
+// Sistemas Operativos, 3er curso
+//============================================
+
+#include <stdio.h>
+#include "regions.h"
+
+/**
+ * Inicializa r con una unica region libre
+ * @r lista de regiones
+ * @paddr direccion de inicio de la memoria
+ * @sizeBitsPow tamaño de la memoria
+ */
+void init_regions(struct Regions *r, seL4_Word paddr, unsigned int sizeBitsPow) {
+
+	r->regions[0].paddr = paddr;
+	r->regions[0].sizeBitsPow = sizeBitsPow;
+	r->regions[0].isAllocated = FALSE;
+	r->regions[0].owner = 0;
+	r->countRegions = 1;
+}
+
+/**
+ * Reserva en r la primera region de memoria de tamaño sizeBitsPow cuya
+ * direccion de inicio cumpla (paddr & mask) == 0. Politica first fit. Falla
+ * tambien si trocear la region no cabe en la lista
+ * @r lista de regiones
+ * @sizeBitsPow tamaño de memoria a reservar
+ * @mask mascara de alineacion (2^n - 1 para alinear a 2^n)
+ * @owner propietario que se anota en la region reservada
+ * @return puntero a la region de memoria reservada, 0 e.o.c
+ */
+seL4_Word allocate_region(struct Regions *r, unsigned int sizeBitsPow, seL4_Word mask, seL4_Word owner) {
+
+	int i = 0, j;
+	seL4_Word paddr;
+
+	// mientras quedan regiones posibles
+	while (i<r->countRegions) {
+		// buscar la rimera region libre (first fit con isAllocated = false) 
+		while (i < r->countRegions && (r->regions[i].isAllocated || r->regions[i].sizeBitsPow < sizeBitsPow))
+			i++;
+		if (i == r->countRegions)
+			break;
+		// coger si direccion de memoria y avanzarla hasta la siguiente alineada
+		paddr = (r->regions[i].paddr + mask) & ~mask;
+		// Con direccion alineada, si hay espacio suficiente para reservar, efectuar reserva
+		if ((paddr - r->regions[i].paddr) <= (r->regions[i].sizeBitsPow - sizeBitsPow)) {
+			// regiones nuevas: resto a la izda y/o resto a la dcha. Si no caben en r->regions[], no se reserva
+			if (r->countRegions + (paddr > r->regions[i].paddr) + (paddr + sizeBitsPow < r->regions[i].paddr + r->regions[i].sizeBitsPow) > MAX_MEMORY_REGIONS)
+				return 0;
+			// si la direccion de inicio de region es alineada
+			if (paddr == r->regions[i].paddr) {
+				// si es de tamaño exacto la refion y el solicitado, no quedan restos libres de la region
+				if (r->regions[i].sizeBitsPow == sizeBitsPow){
+					// marcar como allocated y devolver el puntero, no hace falta trocear |region i tamano 2^sizeBits reservada|
+					r->regions[i].isAllocated = TRUE;
+					r->regions[i].owner = owner;
+				} else {
+					// dividir en la region a reservar y el resto de la region libre |region i tamano 2^sizeBits reservada|nueva region i+1 del resto (r->regions[i].sizeBitsPow - 2^sizeBits) no reservada|
+					for (j = r->countRegions; j>i+1; j--) {
+						// copia de las regiones siguientes una posicion adelante
+						r->regions[j] = r->regions[j-1];
+					}
+					// region resto a la derecha
+					r->regions[i+1].paddr = r->regions[i].paddr + sizeBitsPow;
+					r->regions[i+1].sizeBitsPow = r->regions[i].sizeBitsPow - sizeBitsPow;
+					r->regions[i+1].isAllocated = FALSE;
+					// region reservada
+					//r->regions[i+1].paddr = paddr; //same
+					r->regions[i].sizeBitsPow = sizeBitsPow;
+					r->regions[i].isAllocated = TRUE;
+					r->regions[i].owner = owner;
+					// aumenta contador de regiones
+					r->countRegions++;
+				}
+			} else if ((paddr - r->regions[i].paddr) == (r->regions[i].sizeBitsPow - sizeBitsPow)) {
+				// la seccion a reservar esta desde un punto medio de la region hasta el final, dejando resto parte libre a la izda
+				// |region i del resto (r->regions[i].sizeBitsPow - 2^sizeBits) no reservada|nueva region i+1 tamano 2^sizeBits reservada|
+				for (j = r->countRegions; j>i+1; j--) {
+					// copia de las regiones siguientes una posicion adelante
+					r->regions[j] = r->regions[j-1];
+				}
+				// region reservada
+				r->regions[i+1].paddr = paddr;
+				r->regions[i+1].sizeBitsPow = sizeBitsPow;
+				r->regions[i+1].isAllocated = TRUE;
+				r->regions[i+1].owner = owner;
+				// region resto a la izda
+				r->regions[i].sizeBitsPow -= sizeBitsPow;
+				r->regions[i].isAllocated = FALSE;
+				// aumenta contador de regiones
+				r->countRegions++;
+			} else {
+				// la seccion a reservar es un trozo en punto medio de la region con restos libres a la izda y dcha
+				// |region i del resto (r->regions[i].sizeBitsPow - 2^sizeBits - [i+2].sizeBitsPow) no reservada|nueva region i+1 tamano 2^sizeBits reservada|region i+2 del resto (r->regions[i].sizeBitsPow - 2^sizeBits - [i].sizeBitsPow) no reservada|
+				for (j = r->countRegions+1; j>i+2; j--) {
+					// copia de las regiones siguientes dos posiciones adelante
+					r->regions[j] = r->regions[j-2];
+				}
+				// region resto a la derecha
+				r->regions[i+2].paddr = paddr + sizeBitsPow;
+				r->regions[i+2].sizeBitsPow = r->regions[i].sizeBitsPow - (r->regions[i+2].paddr - r->regions[i].paddr);
+				r->regions[i+2].isAllocated = FALSE;
+				// region reservada
+				r->regions[i+1].paddr = paddr;
+				r->regions[i+1].sizeBitsPow = sizeBitsPow;
+				r->regions[i+1].isAllocated = TRUE;
+				r->regions[i+1].owner = owner;
+				// region resto a la izda
+				r->regions[i].sizeBitsPow = r->regions[i].sizeBitsPow - sizeBitsPow - r->regions[i+2].sizeBitsPow;
+				r->regions[i].isAllocated = FALSE;
+				// aumenta contador de regiones
+				r->countRegions += 2;
+			}
+			return paddr;
+		} else {
+			// seguir buscando a partir de la siguiente region si existe
+			i++;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Busqueda binaria en r (ordenada por paddr) de la region que contiene paddr
+ * @r lista de regiones
+ * @paddr direccion buscada
+ * @return indice de la ultima region que empieza en paddr o antes, -1 si no hay
+ */
+static int search_region(struct Regions *r, seL4_Word paddr) {
+
+	int low = 0, high = r->countRegions - 1, mid;
+
+	while (low <= high) {
+		mid = (low + high) / 2;
+		if (r->regions[mid].paddr <= paddr)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+	return high;
+}
+
+/**
+ * Busca en r la region reservada por owner que empieza en paddr
+ * @r lista de regiones
+ * @paddr puntero al inicio de la region
+ * @owner propietario que debe tener la region
+ * @index donde se devuelve el indice de la region
+ * @return 0 en ejecucion correcta, cogigo de error e.o.c
+ */
+static int find_allocated_region(struct Regions *r, seL4_Word paddr, seL4_Word owner, int *index) {
+
+	int i = search_region(r, paddr);
+
+	// si no encuentra esa region, error
+	if (i < 0 || r->regions[i].paddr != paddr) {
+		printf("ERROR: El puntero 0x%08x no pertenece a ninguna region\n", (unsigned int) paddr);
+		return 1;
+	}
+	// si la region estaya libre, error
+	if (!r->regions[i].isAllocated) {
+		printf("ERROR: El puntero 0x%08x pertenece region libre\n", (unsigned int) paddr);
+		return 2;
+	}
+	// si la region es de otro propietario, error
+	if (r->regions[i].owner != owner) {
+		printf("ERROR: El puntero 0x%08x pertenece a otro propietario\n", (unsigned int) paddr);
+		return 3;
+	}
+	*index = i;
+	return 0;
+}
+
+/**
+ * Libera la region reservada i de r, juntandola con sus vecinas libres
+ * @r lista de regiones
+ * @i indice de la region a liberar
+ */
+static void free_region(struct Regions *r, int i) {
+
+	int j;
+
+	// si es la primera region de r->regions[]
+	if (i == 0) {
+		if (r->countRegions > 1 && !r->regions[i+1].isAllocated) { // |i=0 reservado|i+1 libre|...|
+			// juntar regiones i, i+1
+			r->regions[i].sizeBitsPow += r->regions[i+1].sizeBitsPow;
+			r->regions[i].isAllocated = FALSE;
+			r->countRegions--;
+			for (j=i+1; j<r->countRegions; j++) {
+				// mueve de las regiones siguientes una posicion atras
+				r->regions[j] = r->regions[j+1];
+			}
+		} else { // |i=0 reservado|i+1 reservado|...| o // |i=0 reservado|...vacio...|
+			r->regions[i].isAllocated = FALSE;
+		}
+	} else if (i == r->countRegions-1) {
+		// si es la ultima region de r->regions[]
+		if (!r->regions[i-1].isAllocated) { // |...|i-1 libre|i reservado|
+			// juntar regiones i-1, i
+			r->regions[i-1].sizeBitsPow += r->regions[i].sizeBitsPow;
+			r->countRegions--;
+		} else { // |...|i-1 reservado|i reservado|
+			r->regions[i].isAllocated = FALSE;
+		}
+	} else {
+		// si es una region intermedia
+		// si la izda y la dcha estan reservadas, liberar y terminar
+		if (r->regions[i-1].isAllocated && r->regions[i+1].isAllocated) { // |...|i-1 reservado|i reservado|i+1 reservado|...|
+			r->regions[i].isAllocated = FALSE;
+		} else if (!r->regions[i-1].isAllocated && !r->regions[i+1].isAllocated) { // |...|i-1 libre|i reservado|i+1 libre|...|
+			// si la izda y la dcha estan libres, liberar, juntar y terminar
+			// sumar espacio de las tres regiones
+			r->regions[i-1].sizeBitsPow = r->regions[i-1].sizeBitsPow + r->regions[i].sizeBitsPow + r->regions[i+1].sizeBitsPow;
+			// reducir contador de regiones en 2
+			r->countRegions -= 2;
+			for (j=i; j<r->countRegions; j++) {
+				// mueve de las regiones siguientes dos posiciones atras
+				r->regions[j] = r->regions[j+2];
+			}
+		} else if (r->regions[i-1].isAllocated && !r->regions[i+1].isAllocated) { // |...|i-1 reservado|i reservado|i+1 libre|...|
+			// juntar regiones i, i+1
+			r->regions[i].sizeBitsPow += r->regions[i+1].sizeBitsPow;
+			r->regions[i].isAllocated = FALSE;
+			r->countRegions--;
+			for (j=i+1; j<r->countRegions; j++) {
+				// mueve de las regiones siguientes una posicion atras
+				r->regions[j] = r->regions[j+1];
+			}
+		} else { // |...|i-1 libre|i reservado|i+1 reservado|...|
+			// juntar regiones i-1, i
+			r->regions[i-1].sizeBitsPow += r->regions[i].sizeBitsPow;
+			r->regions[i-1].isAllocated = FALSE;
+			r->countRegions--;
+			for (j=i; j<r->countRegions; j++) {
+				// mueve de las regiones siguientes una posicion atras
+				r->regions[j] = r->regions[j+1];
+			}
+		}
+	}
+}
+
+/**
+ * Libera la region de memoria de r apuntada por paddr
+ * @r lista de regiones
+ * @paddr puntero al inicio de la region de memoria a librerar
+ * @owner propietario que la libera, debe ser el que la reservo
+ * @sizeBitsPow si no es NULL, donde se devuelve el tamaño liberado
+ * @return 0 en ejecucion correcta, cogigo de error e.o.c
+ */
+int release_region(struct Regions *r, seL4_Word paddr, seL4_Word owner, unsigned int *sizeBitsPow) {
+
+	int i, error;
+
+	error = find_allocated_region(r, paddr, owner, &i);
+	if (error != 0)
+		return error;
+	if (sizeBitsPow != NULL)
+		*sizeBitsPow = r->regions[i].sizeBitsPow;
+	free_region(r, i);
+	return 0;
+}
+
+/**
+ * Indice de la region que empieza en paddr, para guardarlo como pista de
+ * release_region_at()
+ * @r lista de regiones
+ * @paddr puntero al inicio de la region
+ * @return indice de la region, -1 si ninguna region empieza en paddr
+ */
+int region_index(struct Regions *r, seL4_Word paddr) {
+
+	int i = search_region(r, paddr);
+
+	return i >= 0 && r->regions[i].paddr == paddr ? i : -1;
+}
+
+/**
+ * Libera la region reservada de r apuntada por paddr probando primero el
+ * indice hint. Si la region sigue en hint se encuentra con un solo acceso;
+ * si la lista se ha movido desde que se tomo la pista, se busca. Juntarla
+ * con sus vecinas libres puede mover las regiones siguientes
+ * @r lista de regiones
+ * @hint indice devuelto por region_index(), -1 si no hay pista
+ * @paddr puntero al inicio de la region de memoria a librerar
+ * @owner propietario que la libera, debe ser el que la reservo
+ * @sizeBitsPow tamaño con el que se reservo la region
+ * @return 0 en ejecucion correcta, 4 si el tamaño no coincide, cogigo de
+ * error de release_region() e.o.c
+ */
+int release_region_at(struct Regions *r, int hint, seL4_Word paddr, seL4_Word owner, unsigned int sizeBitsPow) {
+
+	int i = hint, error;
+
+	if (i < 0 || i >= r->countRegions || r->regions[i].paddr != paddr || !r->regions[i].isAllocated || r->regions[i].owner != owner) {
+		error = find_allocated_region(r, paddr, owner, &i);
+		if (error != 0)
+			return error;
+	}
+	if (r->regions[i].sizeBitsPow != sizeBitsPow) {
+		printf("ERROR: La region 0x%08x no es de %d bytes\n", (unsigned int) paddr, sizeBitsPow);
+		return 4;
+	}
+	free_region(r, i);
+	return 0;
+}
+
+/**
+ * Libera la region de memoria de r apuntada por paddr cuando el llamador
+ * conoce su tamaño, que se comprueba contra el reservado. Es solo una
+ * comprobacion: la lista no es un buddy, asi que la region se busca igual
+ * que en release_region() y liberar no sale mas barato
+ * @r lista de regiones
+ * @paddr puntero al inicio de la region de memoria a librerar
+ * @owner propietario que la libera, debe ser el que la reservo
+ * @sizeBitsPow tamaño con el que se reservo la region
+ * @return 0 en ejecucion correcta, 4 si el tamaño no coincide, cogigo de
+ * error de release_region() e.o.c
+ */
+int release_region_sized(struct Regions *r, seL4_Word paddr, seL4_Word owner, unsigned int sizeBitsPow) {
+
+	return release_region_at(r, -1, paddr, owner, sizeBitsPow);
+}
+
+/**
+ * Cambia sin moverla el tamaño de la region reservada que empieza en paddr.
+ * Para crecer coge el principio de la region libre de la dcha, si la hay y
+ * es suficiente; al encoger, la cola sobrante se junta con la region libre
+ * de la dcha o pasa a ser una region libre nueva
+ * @r lista de regiones
+ * @paddr puntero al inicio de la region
+ * @owner propietario que la cambia, debe ser el que la reservo
+ * @sizeBitsPow nuevo tamaño de la region (mayor que 0)
+ * @oldSizeBitsPow si no es NULL, donde se devuelve el tamaño anterior
+ * @return 0 en ejecucion correcta, 4 si no hay sitio para crecer, 5 si no
+ * caben mas regiones, otro cogigo de error de release_region() e.o.c
+ */
+int resize_region(struct Regions *r, seL4_Word paddr, seL4_Word owner, unsigned int sizeBitsPow, unsigned int *oldSizeBitsPow) {
+
+	int i, j, error;
+	unsigned int size, delta;
+
+	error = find_allocated_region(r, paddr, owner, &i);
+	if (error != 0)
+		return error;
+	size = r->regions[i].sizeBitsPow;
+	if (oldSizeBitsPow != NULL)
+		*oldSizeBitsPow = size;
+	if (sizeBitsPow > size) {
+		// crecer: |i reservado|i+1 libre (al menos delta)|...|
+		delta = sizeBitsPow - size;
+		if (i == r->countRegions-1 || r->regions[i+1].isAllocated || r->regions[i+1].paddr != paddr + size || r->regions[i+1].sizeBitsPow < delta)
+			return 4;
+		r->regions[i].sizeBitsPow = sizeBitsPow;
+		if (r->regions[i+1].sizeBitsPow == delta) {
+			// se come entera la region libre
+			r->countRegions--;
+			for (j=i+1; j<r->countRegions; j++) {
+				// mueve de las regiones siguientes una posicion atras
+				r->regions[j] = r->regions[j+1];
+			}
+		} else {
+			r->regions[i+1].paddr += delta;
+			r->regions[i+1].sizeBitsPow -= delta;
+		}
+	} else if (sizeBitsPow < size) {
+		// encoger: la cola de tamaño delta queda libre
+		delta = size - sizeBitsPow;
+		if (i < r->countRegions-1 && !r->regions[i+1].isAllocated) { // |i reservado|i+1 libre|...|
+			r->regions[i+1].paddr -= delta;
+			r->regions[i+1].sizeBitsPow += delta;
+		} else { // |i reservado|i+1 reservado|...| o |...|i reservado|
+			if (r->countRegions == MAX_MEMORY_REGIONS)
+				return 5;
+			for (j = r->countRegions; j>i+1; j--) {
+				// copia de las regiones siguientes una posicion adelante
+				r->regions[j] = r->regions[j-1];
+			}
+			r->regions[i+1].paddr = paddr + sizeBitsPow;
+			r->regions[i+1].sizeBitsPow = delta;
+			r->regions[i+1].isAllocated = FALSE;
+			r->regions[i+1].owner = 0;
+			r->countRegions++;
+		}
+		r->regions[i].sizeBitsPow = sizeBitsPow;
+	}
+	return 0;
+}
+
+/**
+ * Libera en r todas las regiones de un propietario con una sola pasada,
+ * juntando a la vez las regiones libres contiguas
+ * @r lista de regiones
+ * @owner propietario cuyas regiones se liberan
+ * @mask bits del owner de cada region que se comparan con owner (~0 para
+ *       compararlo entero)
+ * @bytes donde se devuelve el total de bytes liberados
+ * @return numero de regiones liberadas
+ */
+int release_owner(struct Regions *r, seL4_Word owner, seL4_Word mask, seL4_Word *bytes) {
+
+	int i, j = 0, count = 0;
+
+	*bytes = 0;
+	for (i = 0; i < r->countRegions; i++) {
+		if (r->regions[i].isAllocated && (r->regions[i].owner & mask) == owner) {
+			r->regions[i].isAllocated = FALSE;
+			*bytes += r->regions[i].sizeBitsPow;
+			count++;
+		}
+		// si esta libre y la anterior ya copiada tambien, juntarlas
+		if (!r->regions[i].isAllocated && j > 0 && !r->regions[j-1].isAllocated)
+			r->regions[j-1].sizeBitsPow += r->regions[i].sizeBitsPow;
+		else
+			r->regions[j++] = r->regions[i];
+	}
+	r->countRegions = j;
+	return count;
+}
+
+/**
+ * Busca en r la region libre que contiene entera [paddr, paddr+size)
+ * @r lista de regiones
+ * @paddr direccion de inicio buscada
+ * @size tamaño buscado
+ * @return indice de la region libre, -1 e.o.c
+ */
+int find_free_region(struct Regions *r, seL4_Word paddr, seL4_Word size) {
+
+	int i = search_region(r, paddr);
+
+	if (i < 0 || r->regions[i].isAllocated || paddr + size > r->regions[i].paddr + r->regions[i].sizeBitsPow)
+		return -1;
+	return i;
+}
+
+/**
+ * Reserva en r exactamente [paddr, paddr+sizeBitsPow), que debe estar libre,
+ * dejando como regiones libres los restos a izda y dcha
+ * @r lista de regiones
+ * @paddr direccion de inicio a reservar
+ * @sizeBitsPow tamaño a reservar
+ * @owner propietario que se anota en la region reservada
+ * @return 0 en ejecucion correcta, !0 e.o.c
+ */
+int reserve_region(struct Regions *r, seL4_Word paddr, unsigned int sizeBitsPow, seL4_Word owner) {
+
+	int i, j, k, extra;
+	seL4_Word end;
+
+	i = find_free_region(r, paddr, sizeBitsPow);
+	if (i < 0)
+		return 1;
+	end = r->regions[i].paddr + r->regions[i].sizeBitsPow;
+	// regiones nuevas: resto a la izda y/o resto a la dcha
+	extra = (paddr > r->regions[i].paddr) + (paddr + sizeBitsPow < end);
+	if (r->countRegions + extra > MAX_MEMORY_REGIONS)
+		return 2;
+	for (j = r->countRegions + extra - 1; j > i + extra; j--)
+		r->regions[j] = r->regions[j-extra];
+	k = i;
+	if (paddr > r->regions[i].paddr) {
+		// resto a la izda, conserva paddr de la region i
+		r->regions[k].sizeBitsPow = paddr - r->regions[i].paddr;
+		k++;
+	}
+	r->regions[k].paddr = paddr;
+	r->regions[k].sizeBitsPow = sizeBitsPow;
+	r->regions[k].isAllocated = TRUE;
+	r->regions[k].owner = owner;
+	if (paddr + sizeBitsPow < end) {
+		// resto a la dcha
+		r->regions[k+1].paddr = paddr + sizeBitsPow;
+		r->regions[k+1].sizeBitsPow = end - (paddr + sizeBitsPow);
+		r->regions[k+1].isAllocated = FALSE;
+	}
+	r->countRegions += extra;
+	return 0;
+}
@@ -0,0 +1,54 @@
+// Lista estatica de regiones de memoria ordenada por paddr
+// Ingenieria Informatica UPV/EHU
+// Sistemas Operativos, 3er curso
+//============================================
+//
+// Nucleo del asignador first fit de Root_task. Trabaja sobre cualquier
+// struct Regions, de modo que los clientes con un sub-arena delegado
+// pueden usar el mismo asignador sobre su propia memoria.
+
+#ifndef REGIONS_H
+#define REGIONS_H
+
+#include <sel4/sel4.h>
+
+#define FALSE 0
+#define TRUE !(FALSE)
+#define MAX_MEMORY_REGIONS 512
+
+/**
+ * Registro que define una region de memoria
+ * @paddr direccion de inicio de la region
+ * @sizeBitsPow tamaño de la region de memoria (2^sizeBits)
+ * @isAllocated si esta lible (false) u ocupada (true)
+ * @owner propietario de la region reservada (0 = Root_task o asignador local)
+ */
+struct Region {
+    seL4_Word paddr;
+    unsigned int sizeBitsPow;	// si se define como seL4_Uint8 da problema de asignacion
+    seL4_Bool isAllocated;
+    seL4_Word owner;
+};
+
+/**
+ * Lista estatica de regiones (una region = 1..n slots consecutivos)
+ * @regions array con las regiones identificadas
+ * @countRegions contador de diferentes regiones identificadas
+ */
+struct Regions {
+    struct Region regions[MAX_MEMORY_REGIONS];
+    int countRegions;
+};
+
+void init_regions(struct Regions *r, seL4_Word paddr, unsigned int sizeBitsPow);
+seL4_Word allocate_region(struct Regions *r, unsigned int sizeBitsPow, seL4_Word mask, seL4_Word owner);
+int release_region(struct Regions *r, seL4_Word paddr, seL4_Word owner, unsigned int *sizeBitsPow);
+int release_region_sized(struct Regions *r, seL4_Word paddr, seL4_Word owner, unsigned int sizeBitsPow);
+int region_index(struct Regions *r, seL4_Word paddr);
+int release_region_at(struct Regions *r, int hint, seL4_Word paddr, seL4_Word owner, unsigned int sizeBitsPow);
+int resize_region(struct Regions *r, seL4_Word paddr, seL4_Word owner, unsigned int sizeBitsPow, unsigned int *oldSizeBitsPow);
+int release_owner(struct Regions *r, seL4_Word owner, seL4_Word mask, seL4_Word *bytes);
+int find_free_region(struct Regions *r, seL4_Word paddr, seL4_Word size);
+int reserve_region(struct Regions *r, seL4_Word paddr, unsigned int sizeBitsPow, seL4_Word owner);
+
+#endif /* REGIONS_H */